@@ -0,0 +1,29 @@
+#ifndef STRUCT_BENCH_INCLUDED
+#define STRUCT_BENCH_INCLUDED
+/*
+ * bench.h
+ *
+ * Timing helpers shared by the benchmarks.
+ */
+
+#include <time.h>
+
+static double bench_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* keep the compiler from dropping work whose result is unused */
+static void bench_use(const void *p)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    __asm__ volatile("" : : "r"(p) : "memory");
+#else
+    (void)p;
+#endif
+}
+
+#endif /* !STRUCT_BENCH_INCLUDED */
@@ -0,0 +1,115 @@
+/*
+ * bench_delta.c
+ *
+ * Compression ratio and speed of the 'z' and 'r' delta formats against plain
+ * 'q' for 1024 value int64_t arrays: timestamps with small jitter, a counter,
+ * a slow sine and random values. Speeds are in GB/s of int64_t input for
+ * packing and output for unpacking.
+ *
+ * usage: bench_delta
+ */
+#include "struct.h"
+#include "bench.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define N 1024
+
+static int64_t values[N];
+static int64_t back[N];
+static unsigned char buf[N * 10 + 16];
+
+static void fill(int kind)
+{
+    uint64_t x = 88172645463325252ULL;
+    int i;
+
+    for (i = 0; i < N; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        switch (kind) {
+        case 0: /* ms timestamps, 10 ms apart with up to 3 ms jitter */
+            values[i] = 1700000000000LL + i * 10 + (int64_t)(x % 7) - 3;
+            break;
+        case 1:
+            values[i] = 5000000 + i;
+            break;
+        case 2:
+            values[i] = (int64_t)(100000 * sin(i / 50.0));
+            break;
+        default:
+            values[i] = (int64_t)x;
+            break;
+        }
+    }
+}
+
+/* ns per call, best of a few rounds of about 20 ms each */
+static double time_call(const char *fmt, int unpack, int len)
+{
+    double best = 0;
+    double t;
+    long iters = 1;
+    long i;
+    int round;
+
+    for (round = 0; round < 5; round++) {
+        t = bench_now();
+        for (i = 0; i < iters; i++) {
+            if (unpack) {
+                struct_unpack_from(buf, len, 0, fmt, back);
+            } else {
+                struct_pack_into(buf, sizeof(buf), 0, fmt, values);
+            }
+            bench_use(buf);
+            bench_use(back);
+        }
+        t = (bench_now() - t) / iters;
+        if (round == 0 || t < best) {
+            best = t;
+        }
+        iters = (long)(20e6 / t) + 1;
+    }
+    return best;
+}
+
+int main(void)
+{
+    static const char *const kinds[] = {
+        "timestamps", "counter", "sine", "random"
+    };
+    static const char codes[] = "qzr";
+    double pack;
+    double unpack;
+    char fmt[16];
+    int kind;
+    int len;
+    int c;
+
+    printf("%-11s %5s %7s %7s %9s %9s\n", "data", "fmt", "bytes", "ratio",
+            "pack GB/s", "unpk GB/s");
+    for (kind = 0; kind < 4; kind++) {
+        fill(kind);
+        for (c = 0; codes[c] != '\0'; c++) {
+            snprintf(fmt, sizeof(fmt), "<%d%c", N, codes[c]);
+            len = struct_pack_into(buf, sizeof(buf), 0, fmt, values);
+            memset(back, 0, sizeof(back));
+            if (len < 0 || struct_unpack_from(buf, len, 0, fmt, back) != len
+                    || memcmp(back, values, sizeof(values)) != 0) {
+                fprintf(stderr, "%s: round trip failed\n", fmt);
+                return 1;
+            }
+            pack = time_call(fmt, 0, len);
+            unpack = time_call(fmt, 1, len);
+            printf("%-11s %5s %7d %6.2fx %9.2f %9.2f\n", kinds[kind], fmt, len,
+                    (double)sizeof(values) / len, sizeof(values) / pack,
+                    sizeof(values) / unpack);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,104 @@
+/*
+ * bench_parallel.c
+ *
+ * Where struct_pack_parallel() starts beating struct_pack(): packs and
+ * unpacks '!nH' records of growing size serially and on pools of 1 to 8
+ * worker threads (plus the calling thread), with the pool threshold at 0 so
+ * every record is split, and prints the time per record.
+ *
+ * usage: bench_parallel [max_threads]
+ */
+#include "struct.h"
+#include "struct_parallel.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MAX_ELEMS (4 << 20)
+#define MAX_POOLS 8
+
+/* ns per call, best of a few rounds of about 20 ms each */
+static double time_pack(struct_pool_t *pool, const char *fmt,
+        unsigned char *buf, unsigned short *src, int unpack)
+{
+    double best = 0;
+    double t;
+    long iters = 1;
+    long i;
+    int round;
+
+    for (round = 0; round < 5; round++) {
+        t = bench_now();
+        for (i = 0; i < iters; i++) {
+            if (unpack) {
+                struct_unpack_parallel(pool, src, fmt, buf);
+            } else {
+                struct_pack_parallel(pool, buf, fmt, src);
+            }
+            bench_use(buf);
+        }
+        t = (bench_now() - t) / iters;
+        if (round == 0 || t < best) {
+            best = t;
+        }
+        iters = (long)(20e6 / t) + 1;
+    }
+    return best;
+}
+
+int main(int argc, char *argv[])
+{
+    static const int nthreads[] = { 1, 2, 3, 7 };
+    struct_pool_t *pools[MAX_POOLS];
+    int max_threads = (argc > 1) ? atoi(argv[1]) : 7;
+    unsigned short *src;
+    unsigned char *buf;
+    char fmt[32];
+    double serial;
+    double t;
+    int npools = 0;
+    int elems;
+    int unpack;
+    int i;
+
+    src = calloc(MAX_ELEMS, sizeof(*src));
+    buf = calloc(MAX_ELEMS, 2);
+    if (src == NULL || buf == NULL) {
+        return 1;
+    }
+    for (i = 0; i < MAX_ELEMS; i++) {
+        src[i] = (unsigned short)i;
+    }
+    for (i = 0; i < 4 && nthreads[i] <= max_threads; i++) {
+        pools[npools] = struct_pool_create(nthreads[i]);
+        struct_pool_set_threshold(pools[npools], 0);
+        npools++;
+    }
+
+    for (unpack = 0; unpack < 2; unpack++) {
+        printf("%-6s %10s %12s", unpack ? "unpack" : "pack", "bytes",
+                "serial ns");
+        for (i = 0; i < npools; i++) {
+            printf("   %d+1 thr", nthreads[i]);
+        }
+        printf("\n");
+        for (elems = 1 << 10; elems <= MAX_ELEMS; elems <<= 2) {
+            snprintf(fmt, sizeof(fmt), "!%dH", elems);
+            serial = time_pack(NULL, fmt, buf, src, unpack);
+            printf("%-6s %10d %12.0f", "", elems * 2, serial);
+            for (i = 0; i < npools; i++) {
+                t = time_pack(pools[i], fmt, buf, src, unpack);
+                printf("  %8.2fx", serial / t);
+            }
+            printf("\n");
+        }
+    }
+
+    for (i = 0; i < npools; i++) {
+        struct_pool_destroy(pools[i]);
+    }
+    free(src);
+    free(buf);
+    return 0;
+}
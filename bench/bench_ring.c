@@ -0,0 +1,136 @@
+/*
+ * bench_ring.c
+ *
+ * Throughput and latency of struct_ring with 1 to N producer threads and one
+ * consumer. Every producer pushes '!BIQ' records stamped with the time of the
+ * push and retries while the ring is full, the consumer pops them and records
+ * how long each one waited in the ring. The producers run flat out, so the
+ * ring stays full and the latency is mostly the time to drain RING_CAPACITY
+ * records ahead of each one.
+ *
+ * usage: bench_ring [max_producers [records]]
+ */
+#include "struct_ring.h"
+#include "bench.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define RING_FMT "!BIQ"
+#define RING_CAPACITY 1024
+
+#pragma pack(1)
+struct record {
+    uint8_t producer;
+    uint32_t seq;
+    uint64_t stamp;
+};
+#pragma pack()
+
+struct producer {
+    pthread_t tid;
+    struct_ring_t *ring;
+    int id;
+    long count;
+};
+
+static void *produce(void *arg)
+{
+    struct producer *p = arg;
+    struct record rec;
+    long i;
+
+    rec.producer = (uint8_t)p->id;
+    for (i = 0; i < p->count; i++) {
+        rec.seq = (uint32_t)i;
+        rec.stamp = (uint64_t)bench_now();
+        while (struct_ring_push(p->ring, &rec) < 0) {
+            sched_yield();
+            rec.stamp = (uint64_t)bench_now();
+        }
+    }
+    return NULL;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+static int run(int nproducers, long records, double *lat)
+{
+    struct producer prod[64];
+    uint32_t next[64] = { 0 };
+    struct_ring_t *ring;
+    struct record rec;
+    double t;
+    long got = 0;
+    long each = records / nproducers;
+    int i;
+
+    ring = struct_ring_create(RING_FMT, RING_CAPACITY);
+    if (ring == NULL) {
+        return -1;
+    }
+    t = bench_now();
+    for (i = 0; i < nproducers; i++) {
+        prod[i].ring = ring;
+        prod[i].id = i;
+        prod[i].count = each;
+        pthread_create(&prod[i].tid, NULL, produce, &prod[i]);
+    }
+    while (got < each * nproducers) {
+        if (struct_ring_pop(ring, &rec) <= 0) {
+            sched_yield();
+            continue;
+        }
+        if (rec.producer >= nproducers || rec.seq != next[rec.producer]++) {
+            fprintf(stderr, "record out of order\n");
+            return -1;
+        }
+        lat[got++] = bench_now() - (double)rec.stamp;
+    }
+    t = bench_now() - t;
+    for (i = 0; i < nproducers; i++) {
+        pthread_join(prod[i].tid, NULL);
+    }
+    struct_ring_destroy(ring);
+
+    qsort(lat, got, sizeof(*lat), cmp_double);
+    printf("%9d %12.2f %10.0f %10.0f %12.0f\n", nproducers, got / t * 1e3,
+            lat[got / 2], lat[got * 99 / 100], lat[got - 1]);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int max_producers = (argc > 1) ? atoi(argv[1]) : 8;
+    long records = (argc > 2) ? atol(argv[2]) : 1000000;
+    double *lat;
+    int n;
+
+    if (max_producers < 1 || max_producers > 64 || records < max_producers) {
+        fprintf(stderr, "usage: bench_ring [max_producers [records]]\n");
+        return 1;
+    }
+    lat = malloc(records * sizeof(*lat));
+    if (lat == NULL) {
+        return 1;
+    }
+    printf("%d records of %s, ring of %d\n", (int)records, RING_FMT,
+            RING_CAPACITY);
+    printf("producers   Mrec/s     p50 ns     p99 ns       max ns\n");
+    for (n = 1; n <= max_producers; n *= 2) {
+        if (run(n, records, lat) < 0) {
+            return 1;
+        }
+    }
+    free(lat);
+    return 0;
+}
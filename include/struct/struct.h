@@ -37,18 +37,22 @@
  *  -------+--------------------+--------------
  *   I     | unsigned int       | 4
  *  -------+--------------------+--------------
- *   l     | long               | 4
+ *   l     | int32_t            | 4
  *  -------+--------------------+--------------
- *   L     | unsigned long      | 4
+ *   L     | uint32_t           | 4
  *  -------+--------------------+--------------
- *   q     | long long          | 8
+ *   q     | int64_t            | 8
  *  -------+--------------------+--------------
- *   Q     | unsigned long long | 8
+ *   Q     | uint64_t           | 8
  *  -------+--------------------+--------------
  *   f     | float              | 4
  *  -------+--------------------+--------------
  *   d     | double             | 8
  *  -------+--------------------+--------------
+ *   e     | float              | 2 (binary16)
+ *  -------+--------------------+--------------
+ *   E     | float              | 2 (bfloat16)
+ *  -------+--------------------+--------------
  *   s     | char[]             |
  *  -------+--------------------+--------------
  *   p     | char[]             |
@@ -58,16 +62,51 @@
  *   v     | signed varint      |
  *  -------+--------------------+--------------
  *   V     | unsigned varint    |
+ *  -------+--------------------+--------------
+ *   t     | bitfield           |
+ *  -------+--------------------+--------------
+ *   z     | int64_t[]          | delta varint
+ *  -------+--------------------+--------------
+ *   r     | int64_t[]          | delta + frame of reference
  *  ----------------------------+--------------
  *
  *
  * A format character may be preceded by an integral repeat count.
  * For example, the format string '4h' means exactly the same as 'hhhh'.
  *
+ * 'l', 'L', 'q' and 'Q' have the same width in the source struct as packed on
+ * every platform, whatever the size of long. On LP64 a C long field is 'q'.
+ *
  * For the 's' format character, the count is interpreted as the size of the
  * string, not a repeat count like for the other format characters.
  * For example, '10s' means a single 10-byte string.
  *
+ * For the 't' format character, the count is the width of a bitfield from 1
+ * to 32 bits, stored in the smallest of uint8_t, uint16_t and uint32_t that
+ * holds it. Consecutive bitfields share bytes and the run is padded with zero
+ * bits to a whole byte. Big-endian runs fill bytes from the most significant
+ * bit, little-endian runs from the least significant bit. For example,
+ * '!3t5t12t' packs 3 + 5 + 12 bits into 3 bytes, and '8(4t)' packs eight
+ * 4-bit values into 4 bytes.
+ *
+ * For the 'z' and 'r' format characters, the count is the length of an
+ * int64_t array that is delta encoded, which suits timestamps and counters.
+ * 'z' stores every difference as a 'v' varint. 'r' stores the first value as
+ * a 'v' varint and bit-packs the differences in blocks of 128 with the
+ * smallest width that holds them. struct_calcsize() gives the worst case
+ * size of both.
+ *
+ * Format characters may be grouped with parentheses. A group may be preceded
+ * by a repeat count like a single character, '3(BHL)' means 'BHLBHLBHL'.
+ * Instead of a fixed count a group may be followed by '#n', which repeats the
+ * group as many times as the value of the n-th field packed or unpacked so
+ * far. Fields are numbered from 0: every element of a numeric format
+ * character is one field, a 's' or 'p' string is one field, a 't' bitfield
+ * is one field and 'x' pad bytes are not fields. Only the first 16 fields
+ * can be referenced and groups may be nested up to 8 levels.
+ * struct_calcsize() fails on formats with a '#n' group since their size
+ * depends on the data.
+ *
  * Example 1. pack/unpack int type value.
  *
  * char buf[BUFSIZ] = {0, };
@@ -90,12 +129,84 @@
  * struct_pack(buf, fmt, str);
  * struct_unpack(buf, fmt, ostr);
  *
+ * Example 3. pack/unpack a counted array of records.
+ *
+ * #pragma pack(1)
+ * struct frame {
+ *     unsigned char count;
+ *     struct { unsigned char id; unsigned short v; unsigned int t; } e[8];
+ * };
+ * #pragma pack()
+ *
+ * char buf[BUFSIZ] = {0, };
+ * struct frame frm, ofrm;
+ *
+ * struct_pack(buf, "!B(BHI)#0", &frm);
+ * struct_unpack(&ofrm, "!B(BHI)#0", buf);
+ *
+ * Example 4. fill and drain a shared buffer in place.
+ *
+ * char ring[4096];
+ * struct_iter_t it;
+ * int off = 0;
+ * int n;
+ *
+ * while ((n = struct_pack_into(ring, sizeof(ring), off, "!BHI", &rec)) > 0)
+ *     off += n;
+ *
+ * struct_iter_init(&it, ring, off, "!BHI");
+ * while (struct_iter_next(&it, &rec) > 0)
+ *     ...
+ *
  */
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/*
+ * iterator over consecutive records of one format in a buffer,
+ * see struct_iter_init().
+ */
+typedef struct {
+    const void *buf;
+    int buflen;
+    int offset;         /* offset of the next record */
+    const char *fmt;
+} struct_iter_t;
+
+/*
+ * one format character of a described format, see struct_describe().
+ * offsets are -1 when they depend on the data, i.e. after a varint (wire
+ * offset) or inside and after a '#n' group (both offsets).
+ */
+typedef struct {
+    char code;          /* format character */
+    char endian;        /* byte order character in effect, '=' if none */
+    int count;          /* number of elements, length for 's' and 'p',
+                           width in bits for 't' */
+    int host_offset;    /* offset in the source struct */
+    int wire_offset;    /* offset in the packed buffer */
+    int host_size;      /* bytes per element in the source struct */
+    int wire_size;      /* bytes per element packed, maximum for varints,
+                           0 for 't' */
+    int bit_offset;     /* 't': bits packed before it in its first byte */
+} struct_field_t;
+
+typedef struct {
+    /* set by the caller */
+    struct_field_t *fields; /* may be NULL */
+    int max_fields;         /* capacity of fields */
+
+    /* set by struct_describe() */
+    int nfields;            /* can be > max_fields, the rest is not stored */
+    int fixed;              /* 1 if the packed size does not depend on data */
+    int size;               /* packed size, maximum if not fixed, -1 if
+                               unbounded */
+    int host_size;          /* size of the source struct, -1 if unknown */
+    int error;              /* offset of the bad char in fmt, -1 if none */
+} struct_info_t;
+
 /**
  * @brief pack data
  * @return the number of bytes encoded on success, -1 on failure.
@@ -108,6 +219,82 @@ extern int struct_pack(void *buf, const char *fmt, void* src);
  */
 extern int struct_unpack(const void *buf, const char *fmt, void* src);
 
+/**
+ * @brief pack data at offset into a buffer of buflen bytes
+ * @return the number of bytes encoded on success, -1 on failure or when the
+ * data does not fit.
+ */
+extern int struct_pack_into(void *buf, int buflen, int offset,
+        const char *fmt, void* src);
+
+/**
+ * @brief unpack data at offset from a buffer of buflen bytes
+ * @return the number of bytes decoded on success, -1 on failure or when the
+ * buffer ends before the data.
+ */
+extern int struct_unpack_from(const void *buf, int buflen, int offset,
+        const char *fmt, void* dst);
+
+/**
+ * @brief start iterating over the records packed with fmt in buf
+ */
+extern void struct_iter_init(struct_iter_t *it,
+        const void *buf, int buflen, const char *fmt);
+
+/**
+ * @brief unpack the next record into dst
+ * @return the number of bytes decoded, 0 at the end of the buffer,
+ * -1 on failure or when the buffer ends inside a record.
+ */
+extern int struct_iter_next(struct_iter_t *it, void* dst);
+
+/**
+ * @brief convert the multi-byte fields of a packed record to host byte order
+ * in place
+ * @return the size of the record on success, -1 on failure.
+ *
+ * the record keeps its packed layout, so afterwards it can be read through a
+ * struct whose fields sit at the packed offsets, e.g. a '#pragma pack(1)'
+ * struct, or one with 'x' pad bytes where the compiler pads. fmt must be
+ * fixed-size and every field as wide in the struct as packed, which rules
+ * out 'e' and 'E'. calling it again converts back to the byte order of fmt.
+ */
+extern int struct_swap_inplace(void *buf, const char *fmt);
+
+/**
+ * @brief struct_swap_inplace() for n consecutive records of format fmt
+ * @return the number of bytes converted on success, -1 on failure.
+ */
+extern int struct_swap_inplace_array(void *buf, const char *fmt, int n);
+
+/**
+ * @brief pack data followed by a CRC32C of the packed bytes
+ * @return the number of bytes encoded including the 4 byte trailer on success,
+ * -1 on failure.
+ *
+ * the CRC is computed in the same pass as packing and written in the byte
+ * order active at the end of the format.
+ */
+extern int struct_pack_crc32c(void *buf, const char *fmt, void* src);
+
+/**
+ * @brief unpack data written by struct_pack_crc32c() and check its CRC32C
+ * @return the number of bytes decoded including the 4 byte trailer on
+ * success, -1 on failure or when the CRC does not match.
+ */
+extern int struct_unpack_crc32c(const void *buf, const char *fmt, void* src);
+
+/**
+ * @brief validate a format string and describe its fields
+ * @return the number of fields on success, -1 on failure.
+ *
+ * there is one field per format character, '4h' is a single field with a
+ * count of 4, and the body of a group is described once per repetition
+ * ('#n' groups once). on failure info->error is the offset in fmt where
+ * parsing stopped.
+ */
+extern int struct_describe(const char *fmt, struct_info_t *info);
+
 /**
  * @brief calculate the size of a format string
  * @return the number of bytes needed by the format string on success,
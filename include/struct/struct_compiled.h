@@ -0,0 +1,124 @@
+#ifndef STRUCT_COMPILED_INCLUDED
+#define STRUCT_COMPILED_INCLUDED
+/*
+ * struct_compiled.h
+ *
+ * Pack and unpack known formats with generated code.
+ *
+ * tools/struct_gen.c reads a list of fixed-size format strings and writes a C
+ * file with one pack_fmt_<hash>() and one unpack_fmt_<hash>() function per
+ * format, with the loads, stores and byte swaps of every field spelled out,
+ * and a function registering all of them. Once registered, struct_pack(),
+ * struct_unpack(), struct_pack_into() and struct_unpack_from() look the
+ * format up and call the generated code instead of interpreting it, so call
+ * sites do not change. Formats that are not registered are interpreted as
+ * before, and nothing is looked up until the first format is registered.
+ *
+ * Formats may also be given small integer ids. struct_pack_id() writes the id
+ * as a 'V' varint in front of the record, one byte below 128, and
+ * struct_unpack_any() reads it back and unpacks the record with the format of
+ * that id, so messages describe themselves without a switch over format
+ * strings. Ids are looked up in a plain array and the generated code of their
+ * format, if any, is found once when registering, not per message. Without
+ * generated code, formats made only of integers, strings and pad bytes are
+ * scanned once at registration into at most STRUCT_MAX_ID_OPS copies and byte
+ * swaps. Other formats (floats, 'e', 'E', 't', varints, 'z', 'r', '#n' groups
+ * or too many steps) are parsed again for every message, like struct_pack().
+ *
+ * Register formats before other threads start packing, the registry is not
+ * locked.
+ *
+ * Example 1. formats from a config file.
+ *
+ * $ cat formats.txt
+ * !16s16s6BBLLLL16BBBBB
+ * <HHIQ
+ * $ struct_gen -n register_formats -o formats.c formats.txt
+ *
+ * // formats.c is compiled into the program
+ * extern void register_formats(void);
+ *
+ * register_formats();
+ * struct_pack(buf, fmt_from_config, &cfg); // runs pack_fmt_<hash>()
+ *
+ * Example 2. self-describing messages.
+ *
+ * enum { MSG_LOGIN = 1, MSG_SAMPLE = 2 };
+ *
+ * struct_register_id(MSG_LOGIN, "!16s16sI");
+ * struct_register_id(MSG_SAMPLE, "!HHIQ");
+ *
+ * n = struct_pack_id(buf, sizeof(buf), MSG_SAMPLE, &sample);
+ *
+ * // receiver, msg is large enough for any of the records
+ * if (struct_unpack_any(buf, n, &id, &msg) > 0 && id == MSG_SAMPLE)
+ *     ...
+ *
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef STRUCT_MAX_FORMAT_IDS
+#define STRUCT_MAX_FORMAT_IDS 256
+#endif
+
+/* generated code, returns the number of bytes packed or unpacked */
+typedef int (*struct_pack_fn)(void *buf, const void *src);
+typedef int (*struct_unpack_fn)(const void *buf, void *dst);
+
+/**
+ * @brief use pack and unpack for the format fmt
+ * @return 0 on success, -1 when fmt is not fixed-size or the registry is
+ * full.
+ *
+ * fmt is not copied and must stay valid. registering a format again
+ * replaces its functions.
+ */
+extern int struct_register(const char *fmt,
+        struct_pack_fn pack, struct_unpack_fn unpack);
+
+/**
+ * @brief forget all registered formats, they are interpreted again
+ */
+extern void struct_unregister_all(void);
+
+/**
+ * @brief give the format fmt the id id, from 0 to STRUCT_MAX_FORMAT_IDS - 1
+ * @return 0 on success, -1 when id is out of range or fmt is not valid.
+ *
+ * fmt is not copied and must stay valid. registering an id again replaces
+ * its format, a NULL fmt removes it.
+ */
+extern int struct_register_id(int id, const char *fmt);
+
+/**
+ * @brief the format registered for id
+ * @return the format, NULL if there is none.
+ */
+extern const char *struct_id_format(int id);
+
+/**
+ * @brief pack src with the format of id behind a varint of the id into a
+ * buffer of buflen bytes
+ * @return the number of bytes encoded including the id on success, -1 on
+ * failure, when id has no format or when the data does not fit.
+ */
+extern int struct_pack_id(void *buf, int buflen, int id, void *src);
+
+/**
+ * @brief unpack a record written by struct_pack_id() into dst
+ * @return the number of bytes decoded including the id on success, -1 on
+ * failure, when the id has no format or when the buffer ends before the
+ * data.
+ *
+ * the id is stored in *id, which may be NULL.
+ */
+extern int struct_unpack_any(const void *buf, int buflen, int *id, void *dst);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !STRUCT_COMPILED_INCLUDED */
@@ -0,0 +1,65 @@
+#ifndef STRUCT_DELTA_INCLUDED
+#define STRUCT_DELTA_INCLUDED
+/*
+ * struct_delta.h
+ *
+ * Re-pack only the fields of a struct that changed.
+ *
+ * The previous and current source structs are compared word by word and
+ * only the fields overlapping a difference are packed again, either straight
+ * into the packed copy of the previous struct or into a delta stream.
+ *
+ * Fields are numbered from 0 in the order they are packed: every element of
+ * a numeric format character is one field, a 's' or 'p' string is one field
+ * and 'x' pad bytes are not fields. A delta stream is a sequence of entries
+ * made of the field index as a 'V' varint followed by the packed field.
+ *
+ * Only fixed-size formats are supported: no varints and no '#n' groups.
+ *
+ * Example 1. send only what changed.
+ *
+ * char buf[BUFSIZ];
+ * char delta[BUFSIZ];
+ * config_static_t prev, cur;
+ * int n;
+ *
+ * n = struct_delta_pack(delta, sizeof(delta), "!16s16s6BBLLLL16BBBBB",
+ *         &prev, &cur);
+ * ...
+ * struct_delta_unpack(&remote, "!16s16s6BBLLLL16BBBBB", delta, n);
+ *
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief pack the fields that differ between prev and cur into buf
+ * @return the number of fields packed on success, -1 on failure.
+ *
+ * buf must hold the packed form of prev, it then holds the packed form of cur.
+ */
+extern int struct_delta_patch(void *buf, const char *fmt,
+        const void *prev, const void *cur);
+
+/**
+ * @brief write a delta stream of the fields that differ between prev and cur
+ * @return the number of bytes written on success, -1 on failure or when
+ * the stream does not fit in len bytes.
+ */
+extern int struct_delta_pack(void *buf, int len, const char *fmt,
+        const void *prev, const void *cur);
+
+/**
+ * @brief unpack the fields of a delta stream into dst
+ * @return the number of fields unpacked on success, -1 on failure.
+ */
+extern int struct_delta_unpack(void *dst, const char *fmt,
+        const void *buf, int len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !STRUCT_DELTA_INCLUDED */
@@ -0,0 +1,114 @@
+#ifndef STRUCT_FRAME_INCLUDED
+#define STRUCT_FRAME_INCLUDED
+/*
+ * struct_frame.h
+ *
+ * Frames of many records of one format behind a single header.
+ *
+ * A frame starts with an 8 byte header, packed as '!BBHI':
+ *
+ *  ------------------------------------------------
+ *  Offset | Size | Field
+ *  -------+------+---------------------------------
+ *   0     | 1    | byte order of the records, '<' or '>'
+ *   1     | 1    | version, 1
+ *   2     | 2    | format id, chosen by the caller
+ *   4     | 4    | number of records
+ *  ------------------------------------------------
+ *
+ * followed by the records packed back to back. The writer picks the byte
+ * order of the whole frame, usually its own ('='), so it never swaps, and
+ * the reader swaps only if its byte order differs. The byte order character
+ * at the start of fmt, if any, is replaced by the one of the frame.
+ *
+ * Example 1. one frame per write.
+ *
+ * struct_frame_t fr;
+ *
+ * struct_frame_begin(&fr, buf, sizeof(buf), SAMPLE_ID, '=', "HHIQ");
+ * for (i = 0; i < n; i++)
+ *     if (struct_frame_add(&fr, &samples[i]) < 0)
+ *         break;
+ * write(sock, buf, struct_frame_end(&fr));
+ *
+ * // receiver
+ * if (struct_frame_id(buf, len) == SAMPLE_ID
+ *         && struct_frame_open(&fr, buf, len, "HHIQ") == 0)
+ *     while (struct_frame_next(&fr, &sample) > 0)
+ *         ...
+ *
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef STRUCT_FRAME_MAX_FMT
+#define STRUCT_FRAME_MAX_FMT 128
+#endif
+
+#define STRUCT_FRAME_HEADER_SIZE 8
+
+typedef struct {
+    void *buf;
+    int buflen;
+    int offset;         /* end of the records written or read so far */
+    int count;          /* records written, or left to read */
+    int id;             /* format id */
+    char fmt[STRUCT_FRAME_MAX_FMT]; /* fmt with the byte order of the frame */
+} struct_frame_t;
+
+/**
+ * @brief start a frame of records of format fmt in a buffer of buflen bytes
+ * @return 0 on success, -1 on failure.
+ *
+ * id is from 0 to 65535, order is one of '<', '>', '!' and '='. fails when
+ * the header does not fit or fmt is longer than STRUCT_FRAME_MAX_FMT - 2.
+ */
+extern int struct_frame_begin(struct_frame_t *fr, void *buf, int buflen,
+        int id, char order, const char *fmt);
+
+/**
+ * @brief pack src as the next record of the frame
+ * @return the number of bytes encoded on success, -1 on failure or when the
+ * record does not fit, the frame is unchanged then.
+ */
+extern int struct_frame_add(struct_frame_t *fr, void *src);
+
+/**
+ * @brief write the number of records into the header
+ * @return the size of the frame.
+ */
+extern int struct_frame_end(struct_frame_t *fr);
+
+/**
+ * @brief the format id of the frame in buf
+ * @return the id, -1 if buf does not start with a frame header.
+ */
+extern int struct_frame_id(const void *buf, int buflen);
+
+/**
+ * @brief start reading the frame in buf, its records are of format fmt
+ * @return 0 on success, -1 on failure.
+ *
+ * fails when buf does not start with a frame header or, for a fixed-size
+ * fmt, when the header counts more records than buflen bytes hold.
+ */
+extern int struct_frame_open(struct_frame_t *fr, const void *buf, int buflen,
+        const char *fmt);
+
+/**
+ * @brief unpack the next record of the frame into dst
+ * @return the number of bytes decoded, 0 after the last record, -1 on
+ * failure or when the buffer ends inside the frame.
+ *
+ * after the last record fr->offset is the size of the frame, i.e. where the
+ * next frame in buf starts.
+ */
+extern int struct_frame_next(struct_frame_t *fr, void *dst);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !STRUCT_FRAME_INCLUDED */
@@ -0,0 +1,75 @@
+#ifndef STRUCT_PARALLEL_INCLUDED
+#define STRUCT_PARALLEL_INCLUDED
+/*
+ * struct_parallel.h
+ *
+ * Pack and unpack very large records on a small thread pool.
+ *
+ * The format is split at precomputed byte offsets: every run of a fixed-size
+ * format character (e.g. '!262144H') is cut into chunks that are packed or
+ * unpacked concurrently by the pool threads and the calling thread. Records
+ * smaller than the pool threshold, and formats with varints or '#n' groups,
+ * are handed to struct_pack()/struct_unpack() directly.
+ *
+ * Requires POSIX threads, link with -lpthread.
+ *
+ * Example 1. pack a firmware image.
+ *
+ * static unsigned short image[262144];
+ * static char buf[sizeof(image)];
+ * struct_pool_t *pool = struct_pool_create(4);
+ *
+ * struct_pack_parallel(pool, buf, "!262144H", image);
+ * struct_unpack_parallel(pool, image, "!262144H", buf);
+ *
+ * struct_pool_destroy(pool);
+ *
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct struct_pool struct_pool_t;
+
+/**
+ * @brief create a pool of worker threads
+ * @return the pool on success, NULL on failure.
+ *
+ * the calling thread also works on the chunks, so nthreads = 3 uses 4 cores.
+ */
+extern struct_pool_t *struct_pool_create(int nthreads);
+
+/**
+ * @brief stop the worker threads and free the pool
+ */
+extern void struct_pool_destroy(struct_pool_t *pool);
+
+/**
+ * @brief set the packed size in bytes from which records are split
+ */
+extern void struct_pool_set_threshold(struct_pool_t *pool, int bytes);
+
+/**
+ * @brief pack data, see struct_pack()
+ * @return the number of bytes encoded on success, -1 on failure.
+ *
+ * pool may be NULL, then this is the same as struct_pack().
+ */
+extern int struct_pack_parallel(struct_pool_t *pool,
+        void *buf, const char *fmt, void *src);
+
+/**
+ * @brief unpack data, see struct_unpack()
+ * @return the number of bytes decoded on success, -1 on failure.
+ *
+ * pool may be NULL, then this is the same as struct_unpack().
+ */
+extern int struct_unpack_parallel(struct_pool_t *pool,
+        const void *buf, const char *fmt, void *src);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !STRUCT_PARALLEL_INCLUDED */
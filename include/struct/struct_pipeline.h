@@ -0,0 +1,87 @@
+#ifndef STRUCT_PIPELINE_INCLUDED
+#define STRUCT_PIPELINE_INCLUDED
+/*
+ * struct_pipeline.h
+ *
+ * Read packed records from a file or socket and unpack them while the next
+ * reads are in flight.
+ *
+ * The pipeline keeps several buffers of records in flight. On Linux the reads
+ * are queued on an io_uring, several at once for files, so the kernel fills
+ * buffers while the calling thread unpacks the ones already read. Where
+ * io_uring is not available (older kernels, seccomp filters, other systems)
+ * one I/O thread reads with pread()/read(), and poll() for non-blocking
+ * sockets, while the calling thread unpacks. Records may straddle buffers.
+ * Decoded records are handed out in batches, in stream order, to a callback.
+ *
+ * Decoding deliberately stays on the calling thread: unpacking runs at about
+ * memory speed, so the win is overlapping it with the reads, and one decoder
+ * keeps the callback single-threaded and in order with no reorder buffer.
+ * The fallback waits with poll() rather than epoll because a pipeline only
+ * ever waits on one descriptor; with io_uring, non-blocking descriptors wait
+ * on an IORING_OP_POLL_ADD request in the same ring.
+ *
+ * The format must be fixed-size: no varints and no '#n' groups.
+ *
+ * Requires POSIX threads, link with -lpthread.
+ *
+ * Example 1. ingest a file of records.
+ *
+ * static int handle(void *arg, void *records, int n)
+ * {
+ *     struct sample *s = records;
+ *     ...
+ *     return 0;
+ * }
+ *
+ * struct_pipeline_t *pl = struct_pipeline_create("!HHIQ", 4096, 4);
+ * long n = struct_pipeline_run(pl, fd, handle, NULL);
+ * struct_pipeline_destroy(pl);
+ *
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct struct_pipeline struct_pipeline_t;
+
+/**
+ * @brief called with n decoded records, laid out like struct_unpack() writes
+ * them, one after the other.
+ * @return 0 to go on, anything else to stop reading.
+ */
+typedef int (*struct_batch_fn)(void *arg, void *records, int n);
+
+/**
+ * @brief create a pipeline for records of format fmt
+ * @return the pipeline on success, NULL on failure.
+ *
+ * every read fills up to batch records, and up to depth reads are in flight
+ * (at least 2). fmt is not copied and must stay valid.
+ */
+extern struct_pipeline_t *struct_pipeline_create(const char *fmt,
+        int batch, int depth);
+
+/**
+ * @brief free the pipeline
+ */
+extern void struct_pipeline_destroy(struct_pipeline_t *pl);
+
+/**
+ * @brief read fd to the end and hand the decoded records to fn
+ * @return the number of records handed to fn, -1 on a read error or when the
+ * stream ends inside a record.
+ *
+ * regular files are read from their current offset with several reads in
+ * flight, other descriptors with one read at a time. when fn stops the run,
+ * the reads in flight are cancelled or waited for.
+ */
+extern long struct_pipeline_run(struct_pipeline_t *pl, int fd,
+        struct_batch_fn fn, void *arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !STRUCT_PIPELINE_INCLUDED */
@@ -0,0 +1,105 @@
+#ifndef STRUCT_RING_INCLUDED
+#define STRUCT_RING_INCLUDED
+/*
+ * struct_ring.h
+ *
+ * Lock-free ring buffer of packed records.
+ *
+ * Every slot holds struct_calcsize(fmt) bytes. Producers reserve a slot, pack
+ * straight into it and commit it, the consumer unpacks or forwards the packed
+ * bytes in place and releases the slot, so records are never copied through
+ * an intermediate queue. Any number of threads may produce, one thread
+ * consumes.
+ *
+ * Requires C11 atomics.
+ *
+ * Example 1. producer and consumer threads.
+ *
+ * struct_ring_t *ring = struct_ring_create("!BHI", 1024);
+ *
+ * // producers
+ * if (struct_ring_push(ring, &rec) < 0)
+ *     dropped++;
+ *
+ * // consumer
+ * while (struct_ring_pop(ring, &rec) > 0)
+ *     handle(&rec);
+ *
+ * Example 2. forward packed records without unpacking.
+ *
+ * const void *p;
+ * int len;
+ *
+ * while ((p = struct_ring_peek(ring, &len)) != NULL) {
+ *     send(sock, p, len, 0);
+ *     struct_ring_release(ring);
+ * }
+ *
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct struct_ring struct_ring_t;
+
+/**
+ * @brief create a ring of at least capacity records of format fmt
+ * @return the ring on success, NULL on failure.
+ *
+ * capacity is rounded up to a power of two. fmt is not copied and must stay
+ * valid, it may not contain '#n' groups.
+ */
+extern struct_ring_t *struct_ring_create(const char *fmt, int capacity);
+
+/**
+ * @brief free the ring
+ */
+extern void struct_ring_destroy(struct_ring_t *ring);
+
+/**
+ * @brief the size of a slot, i.e. struct_calcsize() of the format
+ */
+extern int struct_ring_record_size(const struct_ring_t *ring);
+
+/**
+ * @brief reserve a slot to pack a record into (producers)
+ * @return the slot, NULL if the ring is full.
+ */
+extern void *struct_ring_reserve(struct_ring_t *ring);
+
+/**
+ * @brief publish a reserved slot holding len packed bytes (producers)
+ */
+extern void struct_ring_commit(struct_ring_t *ring, void *slot, int len);
+
+/**
+ * @brief pack src into the next slot (producers)
+ * @return the number of bytes encoded on success, -1 on failure or when the
+ * ring is full.
+ */
+extern int struct_ring_push(struct_ring_t *ring, void *src);
+
+/**
+ * @brief look at the oldest record without removing it (consumer)
+ * @return the packed record, NULL if the ring is empty.
+ */
+extern const void *struct_ring_peek(struct_ring_t *ring, int *len);
+
+/**
+ * @brief remove the record returned by struct_ring_peek() (consumer)
+ */
+extern void struct_ring_release(struct_ring_t *ring);
+
+/**
+ * @brief unpack the oldest record into dst and remove it (consumer)
+ * @return the number of bytes decoded on success, 0 if the ring is empty,
+ * -1 on failure.
+ */
+extern int struct_ring_pop(struct_ring_t *ring, void *dst);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !STRUCT_RING_INCLUDED */
@@ -1,5 +1,8 @@
 #include "struct.h"
 #include "struct_endian.h"
+#include "struct_internal.h"
+#include "struct_crc32c.h"
+#include "struct_half.h"
 
 #include <stdarg.h>
 #include <stdint.h>
@@ -7,6 +10,7 @@
 #include <string.h>
 #include <ctype.h>
 #include <errno.h>
+#include <limits.h>
 #include <math.h>
 
 #define IEEE754_32_NAN     0x7FC00000
@@ -37,6 +41,82 @@
 
 #define CLEAR_REPETITION(_x) _struct_rep = 0
 
+#ifndef STRUCT_MAX_GROUP_DEPTH
+#define STRUCT_MAX_GROUP_DEPTH 8
+#endif
+
+#ifndef STRUCT_MAX_FIELD_REFS
+#define STRUCT_MAX_FIELD_REFS 16
+#endif
+
+#define INIT_GROUPS(_x) \
+    struct struct_group _struct_groups[STRUCT_MAX_GROUP_DEPTH]; \
+    int _struct_depth = 0
+
+#define BEGIN_GROUP(_refs, _nrefs) \
+    begin_group(_struct_groups, &_struct_depth, &p, _struct_rep, \
+            (_refs), (_nrefs))
+
+#define END_GROUP(_x) end_group(_struct_groups, &_struct_depth, &p)
+
+#define INIT_FIELD_REFS(_x) \
+    int64_t _struct_refs[STRUCT_MAX_FIELD_REFS]; \
+    int _struct_nrefs = 0
+
+#define RECORD_FIELD(_v) do { \
+        if (_struct_nrefs < STRUCT_MAX_FIELD_REFS) { \
+            _struct_refs[_struct_nrefs] = (int64_t)(_v); \
+        } \
+        _struct_nrefs++; \
+    } while (0)
+
+#define SKIP_FIELDS(_n) do { \
+        int _struct_i; \
+        for (_struct_i = 0; _struct_i < (_n) \
+                && _struct_nrefs < STRUCT_MAX_FIELD_REFS; _struct_i++) { \
+            _struct_refs[_struct_nrefs++] = 0; \
+        } \
+        _struct_nrefs += (_n) - _struct_i; \
+    } while (0)
+
+#define RECORD_INT64_FIELDS(_ptr, _n) do { \
+        int _struct_i; \
+        int64_t _struct_v; \
+        for (_struct_i = 0; _struct_i < (_n) \
+                && _struct_nrefs < STRUCT_MAX_FIELD_REFS; _struct_i++) { \
+            memcpy(&_struct_v, (_ptr) + _struct_i * sizeof(int64_t), \
+                    sizeof(int64_t)); \
+            _struct_refs[_struct_nrefs++] = _struct_v; \
+        } \
+        _struct_nrefs += (_n) - _struct_i; \
+    } while (0)
+
+/* widest 't' bitfield */
+#define MAX_BITFIELD 32
+
+/* whether c ends a run of 't' bitfields */
+#define ENDS_BITS(c) \
+    ((c) != 't' && (c) != '(' && (c) != ')' && !isdigit((int)(c)))
+
+/* values per frame-of-reference block of 'r' */
+#define FOR_BLOCK 128
+
+/* 'e' and 'E' values are converted this many at a time */
+#define HALF_BLOCK 64
+
+/* bits of a 't' run not yet packed into, or unpacked from, whole bytes */
+struct bit_state {
+    uint64_t acc;
+    int nbits;
+    int msb;            /* first field in the most significant bits */
+};
+
+struct struct_group {
+    const char *open;   /* the '(' that starts the group */
+    const char *last;   /* last char of the group, including its suffix */
+    int left;           /* iterations still to run */
+};
+
 static int myendian = STRUCT_ENDIAN_NOT_SET;
 
 static void struct_init(void)
@@ -74,7 +154,8 @@ static uint64_t pack_ieee754(long double f,
     }
 
     if (f == 0.0) {
-        return 0; // get this special case out of the way
+        // get this special case out of the way, keeping the sign of -0.0
+        return signbit(f) ? (uint64_t)1 << (bits - 1U) : 0;
     }
 
     // check sign and begin normalization
@@ -105,8 +186,16 @@ static uint64_t pack_ieee754(long double f,
     // shift + bias
     exp = shift + ((1LL << (expbits - 1)) - 1);
 
+    // too small for the implicit leading 1, store it subnormal
+    if (exp <= 0) {
+        significand = (long long)(ldexpl(fnorm + 1.0, exp - 1
+                    + significandbits) + 0.5);
+        exp = 0;
+    }
+
     // return the final answer
-    return (sign << (bits - 1U)) | (exp << (bits - expbits - 1U)) | significand;
+    return ((uint64_t)sign << (bits - 1U))
+        | ((uint64_t)exp << (bits - expbits - 1U)) | (uint64_t)significand;
 }
 
 static long double unpack_ieee754(uint64_t i,
@@ -150,11 +239,20 @@ static long double unpack_ieee754(uint64_t i,
     // pull the significand
     result = (i & ((1LL << significandbits) - 1)); // mask
     result /= (1LL << significandbits); // convert back to float
-    result += 1.0F; // add the one back on
 
     // deal with the exponent
     bias = (1 << (expbits - 1)) - 1;
-    shift = ((i >> significandbits) & ((1LL << expbits) - 1)) - bias;
+    shift = ((i >> significandbits) & ((1LL << expbits) - 1));
+    if (shift == (1LL << expbits) - 1) {
+        // all ones: infinities are handled above, the rest is NaN
+        return NAN;
+    }
+    if (shift == 0) {
+        shift = 1 - (long long)bias; // zero or subnormal, no leading 1
+    } else {
+        shift -= bias;
+        result += 1.0F; // add the one back on
+    }
     while (shift > 0) {
         result *= 2.0;
         shift--;
@@ -170,53 +268,53 @@ static long double unpack_ieee754(uint64_t i,
     return result;
 }
 
+/*
+ * the fields are written and read through a local pointer in one byte order,
+ * swapped before or after, so compilers turn them into one word-sized store
+ * or load plus a byte swap.
+ */
 static void pack_int16_t(unsigned char **bp, uint16_t val, int endian)
 {
-    if (endian == myendian) {
-        *((*bp)++) = val;
-        *((*bp)++) = val >> 8;
-    } else {
-        *((*bp)++) = val >> 8;
-        *((*bp)++) = val;
+    unsigned char *p = *bp;
+
+    if (endian != myendian) {
+        val = STRUCT_BSWAP16(val);
     }
+    p[0] = val;
+    p[1] = val >> 8;
+    *bp = p + 2;
 }
 
 static void pack_int32_t(unsigned char **bp, uint32_t val, int endian)
 {
-    if (endian == myendian) {
-        *((*bp)++) = val;
-        *((*bp)++) = val >> 8;
-        *((*bp)++) = val >> 16;
-        *((*bp)++) = val >> 24;
-    } else {
-        *((*bp)++) = val >> 24;
-        *((*bp)++) = val >> 16;
-        *((*bp)++) = val >> 8;
-        *((*bp)++) = val;
+    unsigned char *p = *bp;
+
+    if (endian != myendian) {
+        val = STRUCT_BSWAP32(val);
     }
+    p[0] = val;
+    p[1] = val >> 8;
+    p[2] = val >> 16;
+    p[3] = val >> 24;
+    *bp = p + 4;
 }
 
 static void pack_int64_t(unsigned char **bp, uint64_t val, int endian)
 {
-    if (endian == myendian) {
-        *((*bp)++) = val;
-        *((*bp)++) = val >> 8;
-        *((*bp)++) = val >> 16;
-        *((*bp)++) = val >> 24;
-        *((*bp)++) = val >> 32;
-        *((*bp)++) = val >> 40;
-        *((*bp)++) = val >> 48;
-        *((*bp)++) = val >> 56;
-    } else {
-        *((*bp)++) = val >> 56;
-        *((*bp)++) = val >> 48;
-        *((*bp)++) = val >> 40;
-        *((*bp)++) = val >> 32;
-        *((*bp)++) = val >> 24;
-        *((*bp)++) = val >> 16;
-        *((*bp)++) = val >> 8;
-        *((*bp)++) = val;
+    unsigned char *p = *bp;
+
+    if (endian != myendian) {
+        val = STRUCT_BSWAP64(val);
     }
+    p[0] = val;
+    p[1] = val >> 8;
+    p[2] = val >> 16;
+    p[3] = val >> 24;
+    p[4] = val >> 32;
+    p[5] = val >> 40;
+    p[6] = val >> 48;
+    p[7] = val >> 56;
+    *bp = p + 8;
 }
 
 static void pack_float(unsigned char **bp, float val, int endian)
@@ -246,16 +344,21 @@ static void pack_signed_varint(unsigned char **bp, int64_t val, int endian)
     pack_varint(bp, uval, endian);
 }
 
+static void unpack_uint16_t(const unsigned char **bp, uint16_t *dst, int endian)
+{
+    const unsigned char *p = *bp;
+    uint16_t val;
+
+    val = (uint16_t)(p[0] | p[1] << 8);
+    *dst = (endian == myendian) ? val : STRUCT_BSWAP16(val);
+    *bp = p + 2;
+}
+
 static void unpack_int16_t(const unsigned char **bp, int16_t *dst, int endian)
 {
     uint16_t val;
-    if (endian == myendian) {
-        val = *((*bp)++);
-        val |= (uint16_t)(*((*bp)++)) << 8;
-    } else {
-        val = (uint16_t)(*((*bp)++)) << 8;
-        val |= *((*bp)++);
-    }
+
+    unpack_uint16_t(bp, &val, endian);
     if (val <= 0x7fffU) {
         *dst = val;
     } else {
@@ -263,31 +366,22 @@ static void unpack_int16_t(const unsigned char **bp, int16_t *dst, int endian)
     }
 }
 
-static void unpack_uint16_t(const unsigned char **bp, uint16_t *dst, int endian)
+static void unpack_uint32_t(const unsigned char **bp, uint32_t *dst, int endian)
 {
-    if (endian == myendian) {
-        *dst = *((*bp)++);
-        *dst |= (uint16_t)(*((*bp)++)) << 8;
-    } else {
-        *dst = (uint16_t)(*((*bp)++)) << 8;
-        *dst |= *((*bp)++);
-    }
+    const unsigned char *p = *bp;
+    uint32_t val;
+
+    val = (uint32_t)p[0] | (uint32_t)p[1] << 8
+        | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+    *dst = (endian == myendian) ? val : STRUCT_BSWAP32(val);
+    *bp = p + 4;
 }
 
 static void unpack_int32_t(const unsigned char **bp, int32_t *dst, int endian)
 {
     uint32_t val;
-    if (endian == myendian) {
-        val = *((*bp)++);
-        val |= (uint32_t)(*((*bp)++)) << 8;
-        val |= (uint32_t)(*((*bp)++)) << 16;
-        val |= (uint32_t)(*((*bp)++)) << 24;
-    } else {
-        val = *((*bp)++) << 24;
-        val |= (uint32_t)(*((*bp)++)) << 16;
-        val |= (uint32_t)(*((*bp)++)) << 8;
-        val |= (uint32_t)(*((*bp)++));
-    }
+
+    unpack_uint32_t(bp, &val, endian);
     if (val <= 0x7fffffffU) {
         *dst = val;
     } else {
@@ -295,43 +389,24 @@ static void unpack_int32_t(const unsigned char **bp, int32_t *dst, int endian)
     }
 }
 
-static void unpack_uint32_t(const unsigned char **bp, uint32_t *dst, int endian)
+static void unpack_uint64_t(const unsigned char **bp, uint64_t *dst, int endian)
 {
-    if (endian == myendian) {
-        *dst = *((*bp)++);
-        *dst |= (uint32_t)(*((*bp)++)) << 8;
-        *dst |= (uint32_t)(*((*bp)++)) << 16;
-        *dst |= (uint32_t)(*((*bp)++)) << 24;
-    } else {
-        *dst = *((*bp)++) << 24;
-        *dst |= (uint32_t)(*((*bp)++)) << 16;
-        *dst |= (uint32_t)(*((*bp)++)) << 8;
-        *dst |= (uint32_t)(*((*bp)++));
-    }
+    const unsigned char *p = *bp;
+    uint64_t val;
+
+    val = (uint64_t)p[0] | (uint64_t)p[1] << 8
+        | (uint64_t)p[2] << 16 | (uint64_t)p[3] << 24
+        | (uint64_t)p[4] << 32 | (uint64_t)p[5] << 40
+        | (uint64_t)p[6] << 48 | (uint64_t)p[7] << 56;
+    *dst = (endian == myendian) ? val : STRUCT_BSWAP64(val);
+    *bp = p + 8;
 }
 
 static void unpack_int64_t(const unsigned char **bp, int64_t *dst, int endian)
 {
     uint64_t val;
-    if (endian == myendian) {
-        val = *((*bp)++);
-        val |= (uint64_t)(*((*bp)++)) << 8;
-        val |= (uint64_t)(*((*bp)++)) << 16;
-        val |= (uint64_t)(*((*bp)++)) << 24;
-        val |= (uint64_t)(*((*bp)++)) << 32;
-        val |= (uint64_t)(*((*bp)++)) << 40;
-        val |= (uint64_t)(*((*bp)++)) << 48;
-        val |= (uint64_t)(*((*bp)++)) << 56;
-    } else {
-        val = (uint64_t)(*((*bp)++)) << 56;
-        val |= (uint64_t)(*((*bp)++)) << 48;
-        val |= (uint64_t)(*((*bp)++)) << 40;
-        val |= (uint64_t)(*((*bp)++)) << 32;
-        val |= (uint64_t)(*((*bp)++)) << 24;
-        val |= (uint64_t)(*((*bp)++)) << 16;
-        val |= (uint64_t)(*((*bp)++)) << 8;
-        val |= *((*bp)++);
-    }
+
+    unpack_uint64_t(bp, &val, endian);
     if (val <= 0x7fffffffffffffffULL) {
         *dst = val;
     } else {
@@ -339,29 +414,6 @@ static void unpack_int64_t(const unsigned char **bp, int64_t *dst, int endian)
     }
 }
 
-static void unpack_uint64_t(const unsigned char **bp, uint64_t *dst, int endian)
-{
-    if (endian == myendian) {
-        *dst = *((*bp)++);
-        *dst |= (uint64_t)(*((*bp)++)) << 8;
-        *dst |= (uint64_t)(*((*bp)++)) << 16;
-        *dst |= (uint64_t)(*((*bp)++)) << 24;
-        *dst |= (uint64_t)(*((*bp)++)) << 32;
-        *dst |= (uint64_t)(*((*bp)++)) << 40;
-        *dst |= (uint64_t)(*((*bp)++)) << 48;
-        *dst |= (uint64_t)(*((*bp)++)) << 56;
-    } else {
-        *dst = (uint64_t)(*((*bp)++)) << 56;
-        *dst |= (uint64_t)(*((*bp)++)) << 48;
-        *dst |= (uint64_t)(*((*bp)++)) << 40;
-        *dst |= (uint64_t)(*((*bp)++)) << 32;
-        *dst |= (uint64_t)(*((*bp)++)) << 24;
-        *dst |= (uint64_t)(*((*bp)++)) << 16;
-        *dst |= (uint64_t)(*((*bp)++)) << 8;
-        *dst |= *((*bp)++);
-    }
-}
-
 static void unpack_float(const unsigned char **bp, float *dst, int endian)
 {
     uint32_t ieee754_encoded_val = 0;
@@ -396,11 +448,537 @@ static void unpack_signed_varint(const unsigned char **bp, int64_t *dst, int end
         *dst = ~*dst;
 }
 
-static int pack_va_list(unsigned char *buf, int offset, const char *fmt, void* src)
+/*
+ * find the ')' closing the group opened at 'open' and parse the optional
+ * '#n' suffix. *last is set to the last char of the group and *ref to the
+ * field index named by the suffix, or -1 if there is none.
+ */
+static int scan_group(const char *open, const char **last, int *ref)
+{
+    const char *p;
+    int depth = 0;
+
+    for (p = open; *p != '\0'; p++) {
+        if (*p == '(') {
+            depth++;
+        } else if (*p == ')' && --depth == 0) {
+            break;
+        }
+    }
+    if (*p == '\0') {
+        return -1;
+    }
+
+    *ref = -1;
+    if (p[1] == '#') {
+        p++;
+        if (!isdigit((int)p[1])) {
+            return -1;
+        }
+        *ref = 0;
+        while (isdigit((int)p[1])) {
+            p++;
+            *ref = *ref * 10 + (*p - '0');
+            if (*ref >= STRUCT_MAX_FIELD_REFS) {
+                return -1;
+            }
+        }
+    }
+    *last = p;
+    return 0;
+}
+
+/*
+ * enter the group at *pp. the body is not expanded, the interpreter loops
+ * back to the '(' until the repeat count is used up (see end_group()).
+ * a group repeated zero times is skipped as a whole.
+ */
+static int begin_group(struct struct_group *groups, int *depth,
+        const char **pp, int rep, const int64_t *refs, int nrefs)
+{
+    const char *last;
+    int ref;
+    int64_t count;
+
+    if (scan_group(*pp, &last, &ref) < 0) {
+        return -1;
+    }
+
+    if (ref >= 0) {
+        /* count taken from a field, refs is NULL when values are unknown */
+        if (rep != 0 || refs == NULL || ref >= nrefs) {
+            return -1;
+        }
+        count = refs[ref];
+        if (count < 0 || count > INT_MAX) {
+            return -1;
+        }
+    } else {
+        count = (rep > 0) ? rep : 1;
+    }
+
+    if (count == 0) {
+        *pp = last;
+        return 0;
+    }
+
+    if (*depth >= STRUCT_MAX_GROUP_DEPTH) {
+        return -1;
+    }
+    groups[*depth].open = *pp;
+    groups[*depth].last = last;
+    groups[*depth].left = (int)count;
+    (*depth)++;
+    return 0;
+}
+
+static int end_group(struct struct_group *groups, int *depth, const char **pp)
+{
+    struct struct_group *g;
+
+    if (*depth == 0) {
+        return -1;
+    }
+
+    g = &groups[*depth - 1];
+    if (--g->left > 0) {
+        *pp = g->open;
+    } else {
+        *pp = g->last;
+        (*depth)--;
+    }
+    return 0;
+}
+
+/* pack a run of n floats as binary16 ('e') or bfloat16 ('E') */
+static void pack_half_run(unsigned char **bp, const unsigned char *src,
+        int n, int c, int endian)
+{
+    float f[HALF_BLOCK];
+    uint16_t h[HALF_BLOCK];
+    int k;
+    int i;
+
+    for (; n > 0; n -= k, src += k * sizeof(float)) {
+        k = (n < HALF_BLOCK) ? n : HALF_BLOCK;
+        memcpy(f, src, k * sizeof(float));
+        if (c == 'e') {
+            struct_float_to_half(h, f, k);
+        } else {
+            struct_float_to_bfloat16(h, f, k);
+        }
+        for (i = 0; i < k; i++) {
+            pack_int16_t(bp, h[i], endian);
+        }
+    }
+}
+
+static void unpack_half_run(const unsigned char **bp, unsigned char *dst,
+        int n, int c, int endian)
+{
+    float f[HALF_BLOCK];
+    uint16_t h[HALF_BLOCK];
+    int k;
+    int i;
+
+    for (; n > 0; n -= k, dst += k * sizeof(float)) {
+        k = (n < HALF_BLOCK) ? n : HALF_BLOCK;
+        for (i = 0; i < k; i++) {
+            unpack_uint16_t(bp, &h[i], endian);
+        }
+        if (c == 'e') {
+            struct_half_to_float(f, h, k);
+        } else {
+            struct_bfloat16_to_float(f, h, k);
+        }
+        memcpy(dst, f, k * sizeof(float));
+    }
+}
+
+/*
+ * 't' bitfields. consecutive fields share bytes and the run is padded with
+ * zero bits to a whole byte at the first character that is not a 't'.
+ * big-endian runs fill each byte from its most significant bit, little-endian
+ * runs from its least significant bit.
+ */
+static int pack_bits(unsigned char **bp, const unsigned char *end,
+        struct bit_state *bs, uint32_t val, int width)
+{
+    uint64_t v = val & (((uint64_t)1 << width) - 1);
+
+    if (bs->msb) {
+        bs->acc = (bs->acc << width) | v;
+        bs->nbits += width;
+        for (; bs->nbits >= 8; bs->nbits -= 8) {
+            if (end != NULL && *bp >= end) {
+                return -1;
+            }
+            *((*bp)++) = bs->acc >> (bs->nbits - 8);
+        }
+    } else {
+        bs->acc |= v << bs->nbits;
+        bs->nbits += width;
+        for (; bs->nbits >= 8; bs->nbits -= 8, bs->acc >>= 8) {
+            if (end != NULL && *bp >= end) {
+                return -1;
+            }
+            *((*bp)++) = bs->acc;
+        }
+    }
+    return 0;
+}
+
+static int flush_bits(unsigned char **bp, const unsigned char *end,
+        struct bit_state *bs)
+{
+    if (bs->nbits > 0) {
+        if (end != NULL && *bp >= end) {
+            return -1;
+        }
+        *((*bp)++) = bs->msb ? bs->acc << (8 - bs->nbits) : bs->acc;
+    }
+    bs->acc = 0;
+    bs->nbits = 0;
+    return 0;
+}
+
+static int unpack_bits(const unsigned char **bp, const unsigned char *end,
+        struct bit_state *bs, uint32_t *val, int width)
+{
+    uint64_t mask = ((uint64_t)1 << width) - 1;
+
+    if (bs->msb) {
+        for (; bs->nbits < width; bs->nbits += 8) {
+            if (end != NULL && *bp >= end) {
+                return -1;
+            }
+            bs->acc = (bs->acc << 8) | *((*bp)++);
+        }
+        *val = (bs->acc >> (bs->nbits - width)) & mask;
+    } else {
+        for (; bs->nbits < width; bs->nbits += 8) {
+            if (end != NULL && *bp >= end) {
+                return -1;
+            }
+            bs->acc |= (uint64_t)*((*bp)++) << bs->nbits;
+        }
+        *val = bs->acc & mask;
+        bs->acc >>= width;
+    }
+    bs->nbits -= width;
+    return 0;
+}
+
+/* bytes a bitfield of width bits takes in the source struct */
+static int bits_host_size(int width)
+{
+    if (width <= 8) {
+        return sizeof(uint8_t);
+    } else if (width <= 16) {
+        return sizeof(uint16_t);
+    }
+    return sizeof(uint32_t);
+}
+
+/*
+ * whether the group at open is a single bitfield like '(4t)', which is run
+ * in one go instead of looping the interpreter.
+ */
+static int bits_group(const char *open, int *width, const char **last)
+{
+    const char *p = open + 1;
+    int w = 0;
+
+    for (; isdigit((int)*p) && w <= MAX_BITFIELD; p++) {
+        w = w * 10 + (*p - '0');
+    }
+    if (p[0] != 't' || p[1] != ')' || p[2] == '#'
+            || w < 1 || w > MAX_BITFIELD) {
+        return 0;
+    }
+    *width = w;
+    *last = p + 1;
+    return 1;
+}
+
+static int varint_size(uint64_t val)
+{
+    int n = 1;
+
+    for (; val >= 0x80 && n < 10; val >>= 7) {
+        n++;
+    }
+    return n;
+}
+
+static int signed_varint_size(int64_t val)
+{
+    uint64_t uval = (uint64_t)val << 1ull;
+    if (val < 0)
+        uval = ~uval;
+    return varint_size(uval);
+}
+
+/* 0 if a complete varint starts at bp, -1 if it would run past end */
+static int varint_room(const unsigned char *bp, const unsigned char *end)
+{
+    int n;
+
+    for (n = 0; bp + n < end && n < 10; n++) {
+        if (!(bp[n] & 0x80)) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/* whether a run of fixed-size characters fits between bp and end */
+static int room_for(const unsigned char *bp, const unsigned char *end,
+        int c, int rep)
+{
+    int size = struct_wire_size(c);
+
+    if (size <= 0) {
+        return 1; /* not a fixed-size character, checked by its case */
+    }
+    return (size_t)(end - bp) / size >= (size_t)((rep > 0) ? rep : 1);
+}
+
+/*
+ * 'z' and 'r' integer arrays. the count is the length of the array and each
+ * run is encoded on its own:
+ *
+ * 'z': every value as a 'v' varint of its difference to the previous one
+ *      (the first to 0).
+ * 'r': the first value as a 'v' varint, then the differences in blocks of
+ *      FOR_BLOCK: the block minimum as a 'v' varint, one byte bit width and
+ *      the differences minus the minimum bit-packed LSB-first. a full block
+ *      is 16 * width bytes, so blocks stay byte aligned. the room for a block
+ *      is checked once and its values are shifted in and out of 64 bit words
+ *      by put_for_block() and get_for_block().
+ */
+static long max_array_size(int c, long n)
+{
+    long blocks = (n - 1 + FOR_BLOCK - 1) / FOR_BLOCK;
+
+    if (c == 'z') {
+        return 10 * n;
+    }
+    return 10 + blocks * 11 + 8 * (n - 1);
+}
+
+static int bit_width(uint64_t val)
+{
+    int w = 0;
+
+    for (; val != 0; val >>= 1) {
+        w++;
+    }
+    return w;
+}
+
+/* bytes of a block of k values of width bits */
+static size_t for_block_size(int k, int width)
+{
+    return ((size_t)k * width + 7) / 8;
+}
+
+/* pack the k values of v, each below 1 << width, LSB-first at p */
+static void put_for_block(unsigned char *p, const uint64_t *v, int k,
+        int width)
+{
+    uint64_t acc = 0;
+    int nbits = 0;
+    int b;
+    int j;
+
+    for (j = 0; j < k && width > 0; j++) {
+        acc |= v[j] << nbits;
+        if (nbits + width < 64) {
+            nbits += width;
+            continue;
+        }
+        for (b = 0; b < 8; b++) {
+            p[b] = (unsigned char)(acc >> 8 * b);
+        }
+        p += 8;
+        /* the bits of v[j] shifted out of the full word */
+        acc = (nbits > 0) ? v[j] >> (64 - nbits) : 0;
+        nbits += width - 64;
+    }
+    for (b = 0; b < nbits; b += 8) {
+        *p++ = (unsigned char)(acc >> b);
+    }
+}
+
+/* unpack the k values of width bits LSB-first from p into v */
+static void get_for_block(const unsigned char *p, uint64_t *v, int k,
+        int width)
+{
+    uint64_t mask = (width < 64) ? ((uint64_t)1 << width) - 1 : ~0ull;
+    uint64_t acc = 0;
+    uint64_t hi;
+    int nbits = 0;
+    int j;
+
+    for (j = 0; j < k && width > 0; j++) {
+        /* whole bytes in, at most 7 bits are left over from the last value */
+        for (; nbits < width && nbits <= 56; nbits += 8) {
+            acc |= (uint64_t)*p++ << nbits;
+        }
+        if (nbits >= width) {
+            v[j] = acc & mask;
+            acc = (width < 64) ? acc >> width : 0;
+            nbits -= width;
+            continue;
+        }
+        /* above 56 bits the top of the value is in the next byte */
+        hi = *p++;
+        v[j] = (acc | hi << nbits) & mask;
+        acc = hi >> (width - nbits);
+        nbits += 8 - width;
+    }
+    if (width == 0) {
+        memset(v, 0, k * sizeof(uint64_t));
+    }
+}
+
+static int pack_delta_run(unsigned char **bp, const unsigned char *end,
+        const unsigned char *src, int n, int c)
+{
+    int64_t x;
+    int64_t d[FOR_BLOCK];
+    uint64_t v[FOR_BLOCK];
+    int64_t min;
+    uint64_t range;
+    uint64_t prev = 0;
+    size_t size;
+    int width;
+    int i;
+    int j;
+    int k;
+
+    if (c == 'z' || n == 1) {
+        for (i = 0; i < ((c == 'z') ? n : 1); i++) {
+            memcpy(&x, src + i * sizeof(int64_t), sizeof(x));
+            if (end != NULL && end - *bp
+                    < signed_varint_size((int64_t)((uint64_t)x - prev))) {
+                return -1;
+            }
+            pack_signed_varint(bp, (int64_t)((uint64_t)x - prev), 0);
+            prev = x;
+        }
+        return 0;
+    }
+
+    memcpy(&x, src, sizeof(x));
+    if (end != NULL && end - *bp < signed_varint_size(x)) {
+        return -1;
+    }
+    pack_signed_varint(bp, x, 0);
+    prev = x;
+
+    for (i = 1; i < n; i += k) {
+        k = (n - i < FOR_BLOCK) ? n - i : FOR_BLOCK;
+        min = INT64_MAX;
+        for (j = 0; j < k; j++) {
+            memcpy(&x, src + (i + j) * sizeof(int64_t), sizeof(x));
+            d[j] = (int64_t)((uint64_t)x - prev);
+            prev = x;
+            if (d[j] < min) {
+                min = d[j];
+            }
+        }
+        range = 0;
+        for (j = 0; j < k; j++) {
+            v[j] = (uint64_t)d[j] - (uint64_t)min;
+            range |= v[j];
+        }
+        width = bit_width(range);
+        size = for_block_size(k, width);
+
+        if (end != NULL && (size_t)(end - *bp)
+                < (size_t)signed_varint_size(min) + 1 + size) {
+            return -1;
+        }
+        pack_signed_varint(bp, min, 0);
+        *((*bp)++) = width;
+        put_for_block(*bp, v, k, width);
+        *bp += size;
+    }
+    return 0;
+}
+
+static int unpack_delta_run(const unsigned char **bp, const unsigned char *end,
+        unsigned char *dst, int n, int c)
+{
+    uint64_t v[FOR_BLOCK];
+    int64_t d;
+    int64_t min;
+    uint64_t prev = 0;
+    size_t size;
+    int width;
+    int i;
+    int j;
+    int k;
+
+    for (i = 0; i < ((c == 'z') ? n : 1); i++) {
+        if (end != NULL && varint_room(*bp, end) < 0) {
+            return -1;
+        }
+        unpack_signed_varint(bp, &d, 0);
+        prev += (uint64_t)d;
+        memcpy(dst + i * sizeof(int64_t), &prev, sizeof(prev));
+    }
+    if (c == 'z') {
+        return 0;
+    }
+
+    for (i = 1; i < n; i += k) {
+        k = (n - i < FOR_BLOCK) ? n - i : FOR_BLOCK;
+        if (end != NULL && varint_room(*bp, end) < 0) {
+            return -1;
+        }
+        unpack_signed_varint(bp, &min, 0);
+        if (end != NULL && *bp >= end) {
+            return -1;
+        }
+        width = *((*bp)++);
+        if (width > 64) {
+            return -1;
+        }
+        size = for_block_size(k, width);
+        if (end != NULL && (size_t)(end - *bp) < size) {
+            return -1;
+        }
+        get_for_block(*bp, v, k, width);
+        *bp += size;
+
+        for (j = 0; j < k; j++) {
+            prev += (uint64_t)min + v[j];
+            memcpy(dst + (i + j) * sizeof(int64_t), &prev, sizeof(prev));
+        }
+    }
+    return 0;
+}
+
+/*
+ * buflen is the size of buf, or -1 if the caller made sure it is big enough.
+ *
+ * when crc is not NULL, a CRC32C of the packed bytes is accumulated while
+ * they are still in cache and appended as a 4 byte trailer in the byte order
+ * active at the end of the format.
+ */
+static int pack_va_list(unsigned char *buf, int buflen, int offset,
+        const char *fmt, void* src, uint32_t *crc)
 {
     INIT_REPETITION();
+    INIT_GROUPS();
+    INIT_FIELD_REFS();
     const char *p;
     unsigned char *bp;
+    unsigned char *end;
+    unsigned char *crc_mark;
     int *ep = &myendian;
     int endian;
 
@@ -415,6 +993,9 @@ static int pack_va_list(unsigned char *buf, int offset, const char *fmt, void* s
     float f;
     double d;
     char s;
+    int n;
+    const char *last;
+    struct bit_state bits = {0, 0, 0};
     int64_t v;
     uint64_t V;
 
@@ -428,8 +1009,22 @@ static int pack_va_list(unsigned char *buf, int offset, const char *fmt, void* s
      * represented by an ellipsis ... parameter.
      */
 
+    if (buflen >= 0 && (offset < 0 || offset > buflen)) {
+        return -1;
+    }
+    end = (buflen >= 0) ? buf + buflen : NULL;
+
     bp = buf + offset;
+    crc_mark = bp;
     for (p = fmt; *p != '\0'; p++) {
+        if (bits.nbits > 0 && ENDS_BITS(*p)
+                && flush_bits(&bp, end, &bits) < 0) {
+            return -1;
+        }
+        if (end != NULL && !room_for(bp, end, *p, _struct_rep)) {
+            return -1;
+        }
+
         switch (*p) {
         case '=': /* native */
             ep = &myendian;
@@ -450,6 +1045,7 @@ static int pack_va_list(unsigned char *buf, int offset, const char *fmt, void* s
             BEGIN_REPETITION();
                 b = *(char*)src;
                 src+=sizeof(char);
+                RECORD_FIELD(b);
 
                 *bp++ = b;
             END_REPETITION();
@@ -458,6 +1054,7 @@ static int pack_va_list(unsigned char *buf, int offset, const char *fmt, void* s
             BEGIN_REPETITION();
                 B = *(unsigned char*)src;
                 src+=sizeof(unsigned char);
+                RECORD_FIELD(B);
 
                 *bp++ = B;
             END_REPETITION();
@@ -466,6 +1063,7 @@ static int pack_va_list(unsigned char *buf, int offset, const char *fmt, void* s
             BEGIN_REPETITION();
                 h = *(short*)src;
                 src+=sizeof(short);
+                RECORD_FIELD(h);
 
                 pack_int16_t(&bp, h, *ep);
             END_REPETITION();
@@ -474,6 +1072,7 @@ static int pack_va_list(unsigned char *buf, int offset, const char *fmt, void* s
             BEGIN_REPETITION();
                 H = *(unsigned short*)src;
                 src+=sizeof(unsigned short);
+                RECORD_FIELD(H);
 
                 pack_int16_t(&bp, H, *ep);
             END_REPETITION();
@@ -483,11 +1082,13 @@ static int pack_va_list(unsigned char *buf, int offset, const char *fmt, void* s
                 if (sizeof(int)==2) {
                     h = *(int*)src;
                     src+=sizeof(int);
+                    RECORD_FIELD(h);
 
                     pack_int16_t(&bp, h, *ep);
                 }else{
                     l = *(int*)src;
                     src+=sizeof(int);
+                    RECORD_FIELD(l);
 
                     pack_int32_t(&bp, l, *ep);
                 }
@@ -498,11 +1099,13 @@ static int pack_va_list(unsigned char *buf, int offset, const char *fmt, void* s
                 if (sizeof(unsigned int)==2) {
                     h = *(unsigned int*)src;
                     src+=sizeof(unsigned int);
+                    RECORD_FIELD(h);
 
                     pack_int16_t(&bp, h, *ep);
                 }else{
                     l = *(unsigned int*)src;
                     src+=sizeof(unsigned int);
+                    RECORD_FIELD(l);
 
                     pack_int32_t(&bp, l, *ep);
                 }
@@ -510,32 +1113,36 @@ static int pack_va_list(unsigned char *buf, int offset, const char *fmt, void* s
             break;
         case 'l':
             BEGIN_REPETITION();
-                l = *(long*)src;
-                src+=sizeof(long);
+                l = *(int32_t*)src;
+                src+=sizeof(int32_t);
+                RECORD_FIELD(l);
 
                 pack_int32_t(&bp, l, *ep);
             END_REPETITION();
             break;
         case 'L':
             BEGIN_REPETITION();
-                L = *(unsigned long*)src;
+                L = *(uint32_t*)src;
                 src+=sizeof(uint32_t);
+                RECORD_FIELD(L);
 
                 pack_int32_t(&bp, L, *ep);
             END_REPETITION();
             break;
         case 'q':
             BEGIN_REPETITION();
-                q = *(long long*)src;
-                src+=sizeof(uint32_t);
+                q = *(int64_t*)src;
+                src+=sizeof(int64_t);
+                RECORD_FIELD(q);
 
                 pack_int64_t(&bp, q, *ep);
             END_REPETITION();
             break;
         case 'Q':
             BEGIN_REPETITION();
-                Q = *(unsigned long long*)src;
-                src+=sizeof(unsigned long long);
+                Q = *(uint64_t*)src;
+                src+=sizeof(uint64_t);
+                RECORD_FIELD(Q);
 
                 pack_int64_t(&bp, Q, *ep);
             END_REPETITION();
@@ -544,6 +1151,7 @@ static int pack_va_list(unsigned char *buf, int offset, const char *fmt, void* s
             BEGIN_REPETITION();
                 f = *(float*)src;
                 src+=sizeof(float);
+                RECORD_FIELD(0); /* floats are no counts */
 
                 pack_float(&bp, f, *ep);
             END_REPETITION();
@@ -552,10 +1160,27 @@ static int pack_va_list(unsigned char *buf, int offset, const char *fmt, void* s
             BEGIN_REPETITION();
                 d = *(double*)src;
                 src+=sizeof(double);
+                RECORD_FIELD(0);
 
                 pack_double(&bp, d, *ep);
             END_REPETITION();
             break;
+        case 'e': /* fall through */
+        case 'E':
+            n = (_struct_rep > 0) ? _struct_rep : 1;
+            pack_half_run(&bp, src, n, *p, *ep);
+            src += n * sizeof(float);
+            SKIP_FIELDS(n);
+            break;
+        case 'z': /* fall through */
+        case 'r':
+            n = (_struct_rep > 0) ? _struct_rep : 1;
+            if (pack_delta_run(&bp, end, src, n, *p) < 0) {
+                return -1;
+            }
+            RECORD_INT64_FIELDS(src, n);
+            src += n * sizeof(int64_t);
+            break;
         case 's': /* fall through */
         case 'p':
             {
@@ -564,6 +1189,7 @@ static int pack_va_list(unsigned char *buf, int offset, const char *fmt, void* s
                 src+=sizeof(char);
                 *bp++ = s;
                 END_REPETITION();
+                RECORD_FIELD(0);
             }
             break;
         case 'x':
@@ -575,7 +1201,11 @@ static int pack_va_list(unsigned char *buf, int offset, const char *fmt, void* s
             BEGIN_REPETITION();
             v = *(int64_t*)src;
             src+=sizeof(int64_t);
+            RECORD_FIELD(v);
 
+            if (end != NULL && end - bp < signed_varint_size(v)) {
+                return -1;
+            }
             pack_signed_varint(&bp, v, *ep);
             END_REPETITION();
             break;
@@ -583,12 +1213,77 @@ static int pack_va_list(unsigned char *buf, int offset, const char *fmt, void* s
             BEGIN_REPETITION();
             V = *(uint64_t*)src;
             src+=sizeof(uint64_t);
+            RECORD_FIELD(V);
 
+            if (end != NULL && end - bp < varint_size(V)) {
+                return -1;
+            }
             pack_varint(&bp, V, *ep);
             END_REPETITION();
             break;
+        case 't':
+            if (_struct_rep < 1 || _struct_rep > MAX_BITFIELD) {
+                return -1;
+            }
+            if (bits.nbits == 0) {
+                bits.msb = (*ep == STRUCT_ENDIAN_BIG);
+            }
+            n = bits_host_size(_struct_rep);
+            if (n == sizeof(uint8_t)) {
+                L = *(uint8_t*)src;
+            } else if (n == sizeof(uint16_t)) {
+                L = *(uint16_t*)src;
+            } else {
+                L = *(uint32_t*)src;
+            }
+            src += n;
+            RECORD_FIELD(L & (((uint64_t)1 << _struct_rep) - 1));
+
+            if (pack_bits(&bp, end, &bits, L, _struct_rep) < 0) {
+                return -1;
+            }
+            break;
+        case '(':
+            if (bits_group(p, &n, &last)) {
+                /* bulk run of equal-width bitfields */
+                if (bits.nbits == 0) {
+                    bits.msb = (*ep == STRUCT_ENDIAN_BIG);
+                }
+                BEGIN_REPETITION();
+                    if (n <= 8) {
+                        L = *(uint8_t*)src;
+                    } else if (n <= 16) {
+                        L = *(uint16_t*)src;
+                    } else {
+                        L = *(uint32_t*)src;
+                    }
+                    src += bits_host_size(n);
+                    RECORD_FIELD(L & (((uint64_t)1 << n) - 1));
+
+                    if (pack_bits(&bp, end, &bits, L, n) < 0) {
+                        return -1;
+                    }
+                END_REPETITION();
+                p = last;
+                CLEAR_REPETITION();
+                continue;
+            }
+            if (BEGIN_GROUP(_struct_refs, _struct_nrefs) < 0) {
+                return -1;
+            }
+            CLEAR_REPETITION();
+            continue;
+        case ')':
+            if (END_GROUP() < 0) {
+                return -1;
+            }
+            CLEAR_REPETITION();
+            continue;
         default:
             if (isdigit((int)*p)) {
+                if (_struct_rep > (INT_MAX - (*p - '0')) / 10) {
+                    return -1;
+                }
                 INC_REPETITION();
             } else {
                 return -1;
@@ -598,19 +1293,49 @@ static int pack_va_list(unsigned char *buf, int offset, const char *fmt, void* s
         if (!isdigit((int)*p)) {
             CLEAR_REPETITION();
         }
+
+        if (crc != NULL && bp != crc_mark) {
+            *crc = struct_crc32c(*crc, crc_mark, bp - crc_mark);
+            crc_mark = bp;
+        }
+    }
+
+    if (flush_bits(&bp, end, &bits) < 0) {
+        return -1;
+    }
+
+    if (crc != NULL) {
+        if (end != NULL && end - bp < 4) {
+            return -1;
+        }
+        *crc = struct_crc32c(*crc, crc_mark, bp - crc_mark);
+        pack_int32_t(&bp, *crc, *ep);
     }
     return (bp - buf);
 }
 
+/*
+ * buflen is the size of buf, or -1 if the caller made sure it is big enough.
+ *
+ * when crc is not NULL, the 4 byte CRC32C trailer written by pack_va_list()
+ * is checked and -1 is returned on a mismatch.
+ */
 static int unpack_va_list(
     const unsigned char *buf,
+    int buflen,
     int offset,
     const char *fmt,
-    void* dst)
+    void* dst,
+    uint32_t *crc)
 {
     INIT_REPETITION();
+    INIT_GROUPS();
+    INIT_FIELD_REFS();
     const char *p;
     const unsigned char *bp;
+    const unsigned char *end;
+    const unsigned char *crc_mark;
+    uint32_t trailer;
     int *ep = &myendian;
     int endian;
 
@@ -625,6 +1350,10 @@ static int unpack_va_list(
     float *f;
     double *d;
     char *s;
+    int n;
+    uint32_t t;
+    const char *last;
+    struct bit_state bits = {0, 0, 0};
     int64_t *v;
     uint64_t *V;
 
@@ -632,8 +1361,23 @@ static int unpack_va_list(
         struct_init();
     }
 
+    if (buflen >= 0 && (offset < 0 || offset > buflen)) {
+        return -1;
+    }
+    end = (buflen >= 0) ? buf + buflen : NULL;
+
     bp = buf + offset;
+    crc_mark = bp;
     for (p = fmt; *p != '\0'; p++) {
+        if (end != NULL && !room_for(bp, end, *p, _struct_rep)) {
+            return -1;
+        }
+        if (ENDS_BITS(*p)) {
+            /* drop the padding of a bitfield run */
+            bits.acc = 0;
+            bits.nbits = 0;
+        }
+
         switch (*p) {
         case '=': /* native */
             ep = &myendian;
@@ -655,6 +1399,7 @@ static int unpack_va_list(
                 b = (char*)dst;
                 dst+=sizeof(char);
                 *b = *bp++;
+                RECORD_FIELD(*b);
             END_REPETITION();
             break;
         case 'B':
@@ -662,6 +1407,7 @@ static int unpack_va_list(
                 B = (unsigned char*)dst;
                 dst+=sizeof(unsigned char);
                 *B = *bp++;
+                RECORD_FIELD(*B);
             END_REPETITION();
             break;
         case 'h':
@@ -669,6 +1415,7 @@ static int unpack_va_list(
                 h = (short*)dst;
                 dst+=sizeof(short);
                 unpack_int16_t(&bp, h, *ep);
+                RECORD_FIELD(*h);
             END_REPETITION();
             break;
         case 'H':
@@ -676,6 +1423,7 @@ static int unpack_va_list(
                 H = (unsigned short*)dst;
                 dst+=sizeof(unsigned short);
                 unpack_uint16_t(&bp, H, *ep);
+                RECORD_FIELD(*H);
             END_REPETITION();
             break;
 
@@ -686,11 +1434,13 @@ static int unpack_va_list(
                     dst+=sizeof(int);
 
                     unpack_int16_t(&bp, h, *ep);
+                    RECORD_FIELD(*h);
                 }else{
                     l = (int*)dst;
                     dst+=sizeof(int);
 
                     unpack_int32_t(&bp, l, *ep);
+                    RECORD_FIELD(*l);
                 }
             END_REPETITION();
             break;
@@ -701,42 +1451,48 @@ static int unpack_va_list(
                     dst+=sizeof(unsigned int);
 
                     unpack_uint16_t(&bp, h, *ep);
+                    RECORD_FIELD(*h);
                 }else{
                     l = (unsigned int*)dst;
                     dst+=sizeof(unsigned int);
 
                     unpack_uint32_t(&bp, l, *ep);
+                    RECORD_FIELD(*l);
                 }
             END_REPETITION();
             break;
         case 'l':
             BEGIN_REPETITION();
-                l = (long*)dst;
-                dst+=sizeof(long);
+                l = (int32_t*)dst;
+                dst+=sizeof(int32_t);
 
                 unpack_int32_t(&bp, l, *ep);
+                RECORD_FIELD(*l);
             END_REPETITION();
             break;
         case 'L':
             BEGIN_REPETITION();
-                L = (unsigned long*)dst;
+                L = (uint32_t*)dst;
                 dst+=sizeof(uint32_t);
 
                 unpack_uint32_t(&bp, L, *ep);
+                RECORD_FIELD(*L);
             END_REPETITION();
             break;
         case 'q':
             BEGIN_REPETITION();
-                q = (long long*)dst;
-                dst+=sizeof(uint32_t);
+                q = (int64_t*)dst;
+                dst+=sizeof(int64_t);
                 unpack_int64_t(&bp, q, *ep);
+                RECORD_FIELD(*q);
             END_REPETITION();
             break;
         case 'Q':
             BEGIN_REPETITION();
-                Q = (unsigned long long*)dst;
-                dst+=sizeof(unsigned long long);
+                Q = (uint64_t*)dst;
+                dst+=sizeof(uint64_t);
                 unpack_uint64_t(&bp, Q, *ep);
+                RECORD_FIELD(*Q);
             END_REPETITION();
             break;
         case 'f':
@@ -744,6 +1500,7 @@ static int unpack_va_list(
                 f = (float*)dst;
                 dst+=sizeof(float);
                 unpack_float(&bp, f, *ep);
+                RECORD_FIELD(0); /* floats are no counts */
             END_REPETITION();
             break;
         case 'd':
@@ -751,8 +1508,25 @@ static int unpack_va_list(
                 d = (double*)dst;
                 dst+=sizeof(double);
                 unpack_double(&bp, d, *ep);
+                RECORD_FIELD(0);
             END_REPETITION();
             break;
+        case 'e': /* fall through */
+        case 'E':
+            n = (_struct_rep > 0) ? _struct_rep : 1;
+            unpack_half_run(&bp, dst, n, *p, *ep);
+            dst += n * sizeof(float);
+            SKIP_FIELDS(n);
+            break;
+        case 'z': /* fall through */
+        case 'r':
+            n = (_struct_rep > 0) ? _struct_rep : 1;
+            if (unpack_delta_run(&bp, end, dst, n, *p) < 0) {
+                return -1;
+            }
+            RECORD_INT64_FIELDS((unsigned char*)dst, n);
+            dst += n * sizeof(int64_t);
+            break;
         case 's': /* fall through */
         case 'p':
             {
@@ -761,6 +1535,7 @@ static int unpack_va_list(
                 dst+=sizeof(char);
                 *s = *bp++;
                 END_REPETITION();
+                RECORD_FIELD(0);
             }
             break;
         case 'x':
@@ -772,18 +1547,85 @@ static int unpack_va_list(
             BEGIN_REPETITION();
             v = (int64_t*)dst;
             dst+=sizeof(int64_t);
+            if (end != NULL && varint_room(bp, end) < 0) {
+                return -1;
+            }
             unpack_signed_varint(&bp, v, *ep);
+            RECORD_FIELD(*v);
             END_REPETITION();
             break;
         case 'V':
             BEGIN_REPETITION();
             V = (uint64_t*)dst;
             dst+=sizeof(uint64_t);
+            if (end != NULL && varint_room(bp, end) < 0) {
+                return -1;
+            }
             unpack_varint(&bp, V, *ep);
+            RECORD_FIELD(*V);
             END_REPETITION();
             break;
+        case 't':
+            if (_struct_rep < 1 || _struct_rep > MAX_BITFIELD) {
+                return -1;
+            }
+            if (bits.nbits == 0) {
+                bits.msb = (*ep == STRUCT_ENDIAN_BIG);
+            }
+            if (unpack_bits(&bp, end, &bits, &t, _struct_rep) < 0) {
+                return -1;
+            }
+            n = bits_host_size(_struct_rep);
+            if (n == sizeof(uint8_t)) {
+                *(uint8_t*)dst = t;
+            } else if (n == sizeof(uint16_t)) {
+                *(uint16_t*)dst = t;
+            } else {
+                *(uint32_t*)dst = t;
+            }
+            dst += n;
+            RECORD_FIELD(t);
+            break;
+        case '(':
+            if (bits_group(p, &n, &last)) {
+                /* bulk run of equal-width bitfields */
+                if (bits.nbits == 0) {
+                    bits.msb = (*ep == STRUCT_ENDIAN_BIG);
+                }
+                BEGIN_REPETITION();
+                    if (unpack_bits(&bp, end, &bits, &t, n) < 0) {
+                        return -1;
+                    }
+                    if (n <= 8) {
+                        *(uint8_t*)dst = t;
+                    } else if (n <= 16) {
+                        *(uint16_t*)dst = t;
+                    } else {
+                        *(uint32_t*)dst = t;
+                    }
+                    dst += bits_host_size(n);
+                    RECORD_FIELD(t);
+                END_REPETITION();
+                p = last;
+                CLEAR_REPETITION();
+                continue;
+            }
+            if (BEGIN_GROUP(_struct_refs, _struct_nrefs) < 0) {
+                return -1;
+            }
+            CLEAR_REPETITION();
+            continue;
+        case ')':
+            if (END_GROUP() < 0) {
+                return -1;
+            }
+            CLEAR_REPETITION();
+            continue;
         default:
             if (isdigit((int)*p)) {
+                if (_struct_rep > (INT_MAX - (*p - '0')) / 10) {
+                    return -1;
+                }
                 INC_REPETITION();
             } else {
                 return -1;
@@ -793,10 +1635,125 @@ static int unpack_va_list(
         if (!isdigit((int)*p)) {
             CLEAR_REPETITION();
         }
+
+        if (crc != NULL && bp != crc_mark) {
+            *crc = struct_crc32c(*crc, crc_mark, bp - crc_mark);
+            crc_mark = bp;
+        }
+    }
+
+    if (crc != NULL) {
+        if (end != NULL && end - bp < 4) {
+            return -1;
+        }
+        *crc = struct_crc32c(*crc, crc_mark, bp - crc_mark);
+        unpack_uint32_t(&bp, &trailer, *ep);
+        if (trailer != *crc) {
+            return -1;
+        }
     }
     return (bp - buf);
 }
 
+/*
+ * in-place byte order conversion. the fields that need swapping are listed
+ * once per format, merged where runs of one size are adjacent, and the list
+ * is then applied to every record.
+ */
+#ifndef STRUCT_SWAP_MAX_RUNS
+#define STRUCT_SWAP_MAX_RUNS 32
+#endif
+
+struct swap_run {
+    int offset;
+    int size;           /* 2, 4 or 8 */
+    int count;
+};
+
+struct swap_plan {
+    struct swap_run runs[STRUCT_SWAP_MAX_RUNS];
+    int nruns;
+    int overflow;       /* more runs than fit, walk every record instead */
+    unsigned char *rec; /* record being swapped when walking */
+};
+
+static void swap_elems(unsigned char *p, int size, long count)
+{
+    uint16_t v16;
+    uint32_t v32;
+    uint64_t v64;
+    long i;
+
+    /* memcpy() keeps unaligned fields legal, the loops vectorize */
+    switch (size) {
+    case 2:
+        for (i = 0; i < count; i++, p += 2) {
+            memcpy(&v16, p, 2);
+            v16 = STRUCT_BSWAP16(v16);
+            memcpy(p, &v16, 2);
+        }
+        break;
+    case 4:
+        for (i = 0; i < count; i++, p += 4) {
+            memcpy(&v32, p, 4);
+            v32 = STRUCT_BSWAP32(v32);
+            memcpy(p, &v32, 4);
+        }
+        break;
+    case 8:
+        for (i = 0; i < count; i++, p += 8) {
+            memcpy(&v64, p, 8);
+            v64 = STRUCT_BSWAP64(v64);
+            memcpy(p, &v64, 8);
+        }
+        break;
+    }
+}
+
+static int swap_plan_run(void *arg, char endian, char c, int count,
+        size_t host_offset, size_t wire_offset)
+{
+    struct swap_plan *sp = arg;
+    struct swap_run *r;
+    int size = struct_wire_size(c);
+    int order = myendian;
+
+    if (c == 'x') {
+        return 0;
+    }
+    /* the field must be as wide in the struct as in the buffer */
+    if (struct_host_size(c) != size) {
+        return -1;
+    }
+    if (endian == '<') {
+        order = STRUCT_ENDIAN_LITTLE;
+    } else if (endian == '>' || endian == '!') {
+        order = STRUCT_ENDIAN_BIG;
+    }
+    if (size == 1 || order == myendian) {
+        return 0;
+    }
+
+    if (sp->rec != NULL) {
+        swap_elems(sp->rec + wire_offset, size, count);
+        return 0;
+    }
+    r = (sp->nruns > 0) ? &sp->runs[sp->nruns - 1] : NULL;
+    if (r != NULL && r->size == size
+            && r->offset + r->size * r->count == (int)wire_offset) {
+        r->count += count;
+    } else if (sp->nruns < STRUCT_SWAP_MAX_RUNS) {
+        r = &sp->runs[sp->nruns++];
+        r->offset = (int)wire_offset;
+        r->size = size;
+        r->count = count;
+    } else {
+        sp->overflow = 1;
+    }
+    (void)host_offset;
+    return 0;
+}
+
 /*
  * EXPORT
  *
@@ -805,21 +1762,49 @@ static int unpack_va_list(
  */
 int struct_pack(void *buf, const char *fmt, void* src)
 {
-    int packed_len = pack_va_list((unsigned char*)buf, 0, fmt, (unsigned char*)src);
+    const struct struct_compiled *c = struct_compiled_find(fmt);
+    int packed_len;
+
+    if (c != NULL) {
+        return c->pack(buf, src);
+    }
+    packed_len = pack_va_list((unsigned char*)buf, -1, 0, fmt, (unsigned char*)src, NULL);
 
     return packed_len;
 }
 
 int struct_unpack(const void *buf, const char *fmt, void* src)
 {
-    int unpacked_len = unpack_va_list((unsigned char*)src, 0, fmt, (unsigned char*)buf);
+    const struct struct_compiled *c = struct_compiled_find(fmt);
+    int unpacked_len;
+
+    if (c != NULL) {
+        return c->unpack(src, (void*)buf);
+    }
+    unpacked_len = unpack_va_list((unsigned char*)src, -1, 0, fmt, (unsigned char*)buf, NULL);
     return unpacked_len;
 }
 
+int struct_pack_crc32c(void *buf, const char *fmt, void* src)
+{
+    uint32_t crc = 0;
+
+    return pack_va_list((unsigned char*)buf, -1, 0, fmt, (unsigned char*)src, &crc);
+}
+
+int struct_unpack_crc32c(const void *buf, const char *fmt, void* src)
+{
+    uint32_t crc = 0;
+
+    return unpack_va_list((unsigned char*)src, -1, 0, fmt, (unsigned char*)buf, &crc);
+}
+
 int struct_calcsize(const char *fmt)
 {
     INIT_REPETITION();
-    int ret = 0;
+    INIT_GROUPS();
+    long long ret = 0;
+    long long bits = 0;
     const char *p;
 
     if (STRUCT_ENDIAN_NOT_SET == myendian) {
@@ -827,6 +1812,11 @@ int struct_calcsize(const char *fmt)
     }
 
     for (p = fmt; *p != '\0'; p++) {
+        if (bits > 0 && ENDS_BITS(*p)) {
+            ret += (bits + 7) / 8;
+            bits = 0;
+        }
+
         switch (*p) {
         case '=': /* fall through */
         case '<': /* fall through */
@@ -893,6 +1883,16 @@ int struct_calcsize(const char *fmt)
             ret += sizeof(int64_t); // see pack_double()
             END_REPETITION();
             break;
+        case 'e': /* fall through */
+        case 'E':
+            BEGIN_REPETITION();
+            ret += sizeof(int16_t);
+            END_REPETITION();
+            break;
+        case 'z': /* fall through */
+        case 'r':
+            ret += max_array_size(*p, (_struct_rep > 0) ? _struct_rep : 1);
+            break;
         case 's': /* fall through */
         case 'p':
             BEGIN_REPETITION();
@@ -914,8 +1914,29 @@ int struct_calcsize(const char *fmt)
             ret += 10;
             END_REPETITION();
             break;
+        case 't':
+            if (_struct_rep < 1 || _struct_rep > MAX_BITFIELD) {
+                return -1;
+            }
+            bits += _struct_rep;
+            break;
+        case '(':
+            if (BEGIN_GROUP(NULL, 0) < 0) {
+                return -1;
+            }
+            CLEAR_REPETITION();
+            continue;
+        case ')':
+            if (END_GROUP() < 0) {
+                return -1;
+            }
+            CLEAR_REPETITION();
+            continue;
         default:
             if (isdigit((int)*p)) {
+                if (_struct_rep > (INT_MAX - (*p - '0')) / 10) {
+                    return -1;
+                }
                 INC_REPETITION();
             } else {
                 return -1;
@@ -925,6 +1946,387 @@ int struct_calcsize(const char *fmt)
         if (!isdigit((int)*p)) {
             CLEAR_REPETITION();
         }
+        if (ret > INT_MAX || bits > INT_MAX) {
+            return -1;
+        }
+    }
+    ret += (bits + 7) / 8;
+    return (ret > INT_MAX) ? -1 : (int)ret;
+}
+
+int struct_pack_into(void *buf, int buflen, int offset,
+        const char *fmt, void* src)
+{
+    const struct struct_compiled *c = struct_compiled_find(fmt);
+    int packed_len;
+
+    if (c != NULL) {
+        if (offset < 0 || offset > buflen || buflen - offset < c->size) {
+            return -1;
+        }
+        return c->pack((unsigned char*)buf + offset, src);
+    }
+    packed_len = pack_va_list((unsigned char*)buf, buflen, offset, fmt,
+            (unsigned char*)src, NULL);
+
+    return (packed_len < 0) ? -1 : packed_len - offset;
+}
+
+int struct_unpack_from(const void *buf, int buflen, int offset,
+        const char *fmt, void* dst)
+{
+    const struct struct_compiled *c = struct_compiled_find(fmt);
+    int unpacked_len;
+
+    if (c != NULL) {
+        if (offset < 0 || offset > buflen || buflen - offset < c->size) {
+            return -1;
+        }
+        return c->unpack((const unsigned char*)buf + offset, dst);
+    }
+    unpacked_len = unpack_va_list((const unsigned char*)buf, buflen,
+            offset, fmt, (unsigned char*)dst, NULL);
+
+    return (unpacked_len < 0) ? -1 : unpacked_len - offset;
+}
+
+void struct_iter_init(struct_iter_t *it,
+        const void *buf, int buflen, const char *fmt)
+{
+    it->buf = buf;
+    it->buflen = buflen;
+    it->offset = 0;
+    it->fmt = fmt;
+}
+
+int struct_iter_next(struct_iter_t *it, void* dst)
+{
+    int n;
+
+    if (it->offset >= it->buflen) {
+        return 0;
+    }
+
+    n = struct_unpack_from(it->buf, it->buflen, it->offset, it->fmt, dst);
+    if (n <= 0) {
+        return -1;
+    }
+    it->offset += n;
+    return n;
+}
+
+int struct_swap_inplace(void *buf, const char *fmt)
+{
+    return struct_swap_inplace_array(buf, fmt, 1);
+}
+
+int struct_swap_inplace_array(void *buf, const char *fmt, int n)
+{
+    struct swap_plan sp;
+    unsigned char *rec;
+    int size;
+    int i;
+    int j;
+
+    if (STRUCT_ENDIAN_NOT_SET == myendian) {
+        struct_init();
+    }
+
+    sp.nruns = 0;
+    sp.overflow = 0;
+    sp.rec = NULL;
+    size = struct_walk_runs(fmt, swap_plan_run, &sp);
+    if (size < 0 || n < 0 || (size > 0 && n > INT_MAX / size)) {
+        return -1;
+    }
+
+    if (sp.overflow) {
+        for (i = 0, rec = buf; i < n; i++, rec += size) {
+            sp.rec = rec;
+            struct_walk_runs(fmt, swap_plan_run, &sp);
+        }
+    } else if (sp.nruns == 1 && sp.runs[0].offset == 0
+            && sp.runs[0].size * sp.runs[0].count == size) {
+        /* records of a single field type, e.g. '!4I': one long run */
+        swap_elems(buf, sp.runs[0].size, (long)sp.runs[0].count * n);
+    } else {
+        for (i = 0, rec = buf; i < n; i++, rec += size) {
+            for (j = 0; j < sp.nruns; j++) {
+                swap_elems(rec + sp.runs[j].offset, sp.runs[j].size,
+                        sp.runs[j].count);
+            }
+        }
+    }
+    return size * n;
+}
+
+int struct_describe(const char *fmt, struct_info_t *info)
+{
+    INIT_REPETITION();
+    INIT_GROUPS();
+    const char *p;
+    const char *last;
+    char endian = '=';
+    int ref;
+    int count;
+    int host;
+    int wire;
+    int elems = 0;          /* fields as numbered by '#n' */
+    int varying = 0;        /* wire offsets depend on data */
+    int unbounded = 0;      /* both offsets depend on data */
+    long long host_offset = 0;
+    long long wire_offset = 0;
+    long long bits = 0;     /* pending bits of a 't' run */
+    struct_field_t *f;
+
+    info->nfields = 0;
+    info->fixed = 1;
+    info->size = -1;
+    info->host_size = -1;
+    info->error = -1;
+
+    for (p = fmt; *p != '\0'; p++) {
+        if (bits > 0 && ENDS_BITS(*p)) {
+            wire_offset += (bits + 7) / 8;
+            bits = 0;
+        }
+
+        switch (*p) {
+        case '=': /* fall through */
+        case '<': /* fall through */
+        case '>': /* fall through */
+        case '!':
+            endian = *p;
+            break;
+        case '(':
+            if (scan_group(p, &last, &ref) < 0) {
+                goto fail;
+            }
+            if (ref < 0) {
+                if (BEGIN_GROUP(NULL, 0) < 0) {
+                    goto fail;
+                }
+            } else {
+                /* the count depends on the data, describe the body once */
+                if (_struct_rep != 0 || ref >= elems
+                        || _struct_depth >= STRUCT_MAX_GROUP_DEPTH) {
+                    goto fail;
+                }
+                _struct_groups[_struct_depth].open = p;
+                _struct_groups[_struct_depth].last = last;
+                _struct_groups[_struct_depth].left = 1;
+                _struct_depth++;
+                info->fixed = 0;
+                unbounded = 1;
+            }
+            CLEAR_REPETITION();
+            continue;
+        case ')':
+            if (END_GROUP() < 0) {
+                goto fail;
+            }
+            CLEAR_REPETITION();
+            continue;
+        default:
+            if (isdigit((int)*p)) {
+                if (_struct_rep > (INT_MAX - (*p - '0')) / 10) {
+                    goto fail;
+                }
+                INC_REPETITION();
+                continue;
+            }
+            count = (_struct_rep > 0) ? _struct_rep : 1;
+            if (*p == 't') {
+                if (_struct_rep < 1 || _struct_rep > MAX_BITFIELD) {
+                    goto fail;
+                }
+                host = bits_host_size(count);
+                wire = 0;
+            } else {
+                host = struct_host_size(*p);
+                if (host < 0) {
+                    goto fail;
+                }
+                wire = struct_wire_size(*p);
+            }
+
+            if (info->nfields < info->max_fields && info->fields != NULL) {
+                f = &info->fields[info->nfields];
+                f->code = *p;
+                f->endian = endian;
+                f->count = count;
+                f->host_offset = unbounded ? -1 : (int)host_offset;
+                f->wire_offset = (unbounded || varying)
+                    ? -1 : (int)(wire_offset + bits / 8);
+                f->bit_offset = (int)(bits % 8);
+                f->host_size = host;
+                f->wire_size = (wire < 0) ? 10 : wire;
+            }
+            info->nfields++;
+
+            if (*p == 't') {
+                host_offset += host;
+                bits += count;
+                elems++;
+                break;
+            }
+
+            if (wire < 0) {
+                wire = 10; /* see calcsize() */
+                info->fixed = 0;
+                varying = 1;
+            }
+            host_offset += (long long)count * host;
+            if (*p == 'z' || *p == 'r') {
+                wire_offset += max_array_size(*p, count);
+            } else {
+                wire_offset += (long long)count * wire;
+            }
+            if (wire_offset > INT_MAX || host_offset > INT_MAX) {
+                goto fail;
+            }
+
+            if (*p == 's' || *p == 'p') {
+                elems++;
+            } else if (*p != 'x') {
+                elems += (count < INT_MAX - elems) ? count : INT_MAX - elems;
+            }
+        }
+        CLEAR_REPETITION();
+    }
+
+    wire_offset += (bits + 7) / 8;
+    if (!unbounded) {
+        info->size = (int)wire_offset;
+        info->host_size = (int)host_offset;
+    }
+    return info->nfields;
+
+fail:
+    info->error = (int)(p - fmt);
+    return -1;
+}
+
+/*
+ * INTERNAL
+ *
+ * per-character sizes shared with the other modules, see struct_internal.h.
+ * these must follow what pack_va_list() and unpack_va_list() do.
+ */
+int struct_host_size(int c)
+{
+    switch (c) {
+    case 'b': return sizeof(char);
+    case 'B': return sizeof(unsigned char);
+    case 'h': return sizeof(short);
+    case 'H': return sizeof(unsigned short);
+    case 'i': return sizeof(int);
+    case 'I': return sizeof(unsigned int);
+    case 'l': return sizeof(int32_t);
+    case 'L': return sizeof(uint32_t);
+    case 'q': return sizeof(int64_t);
+    case 'Q': return sizeof(uint64_t);
+    case 'f': return sizeof(float);
+    case 'd': return sizeof(double);
+    case 'e': /* fall through */
+    case 'E': return sizeof(float);
+    case 's': /* fall through */
+    case 'p': return sizeof(char);
+    case 'x': return 0;
+    case 'v': return sizeof(int64_t);
+    case 'V': return sizeof(uint64_t);
+    case 'z': /* fall through */
+    case 'r': return sizeof(int64_t);
+    default: return -1;
+    }
+}
+
+int struct_wire_size(int c)
+{
+    switch (c) {
+    case 'b': /* fall through */
+    case 'B': return 1;
+    case 'h': /* fall through */
+    case 'H': return 2;
+    case 'i': /* fall through */
+    case 'I': return (sizeof(int) == 2) ? 2 : 4;
+    case 'l': /* fall through */
+    case 'L': return 4;
+    case 'q': /* fall through */
+    case 'Q': return 8;
+    case 'f': return 4;
+    case 'd': return 8;
+    case 'e': /* fall through */
+    case 'E': return 2;
+    case 's': /* fall through */
+    case 'p': /* fall through */
+    case 'x': return 1;
+    default: return -1; /* variable ('v', 'V') or unknown */
+    }
+}
+
+int struct_walk_runs(const char *fmt, struct_run_fn fn, void *arg)
+{
+    INIT_REPETITION();
+    INIT_GROUPS();
+    const char *p;
+    char endian = '=';
+    int count;
+    int host;
+    int wire;
+    size_t host_offset = 0;
+    size_t wire_offset = 0;
+
+    for (p = fmt; *p != '\0'; p++) {
+        switch (*p) {
+        case '=': /* fall through */
+        case '<': /* fall through */
+        case '>': /* fall through */
+        case '!':
+            endian = *p;
+            break;
+        case '(':
+            if (BEGIN_GROUP(NULL, 0) < 0) {
+                return -1;
+            }
+            CLEAR_REPETITION();
+            continue;
+        case ')':
+            if (END_GROUP() < 0) {
+                return -1;
+            }
+            CLEAR_REPETITION();
+            continue;
+        default:
+            if (isdigit((int)*p)) {
+                if (_struct_rep > (INT_MAX - (*p - '0')) / 10) {
+                    return -1;
+                }
+                INC_REPETITION();
+                continue;
+            }
+            host = struct_host_size(*p);
+            wire = struct_wire_size(*p);
+            if (host < 0 || wire < 0) {
+                return -1;
+            }
+            count = (_struct_rep > 0) ? _struct_rep : 1;
+            if (fn != NULL && fn(arg, endian, *p, count,
+                        host_offset, wire_offset) < 0) {
+                return -1;
+            }
+            host_offset += (size_t)count * host;
+            wire_offset += (size_t)count * wire;
+            if (wire_offset > INT_MAX) {
+                return -1;
+            }
+        }
+        CLEAR_REPETITION();
     }
-    return ret;
-}
\ No newline at end of file
+    return (int)wire_offset;
+}
+
+void struct_swap_elems(void *p, int size, long count)
+{
+    swap_elems(p, size, count);
+}
@@ -0,0 +1,368 @@
+#include "struct.h"
+#include "struct_compiled.h"
+#include "struct_internal.h"
+#include "struct_endian.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#ifndef STRUCT_MAX_COMPILED
+#define STRUCT_MAX_COMPILED 256
+#endif
+
+#ifndef STRUCT_MAX_ID_OPS
+#define STRUCT_MAX_ID_OPS 8
+#endif
+
+/* open addressing, kept at most half full */
+#define COMPILED_SLOTS (2 * STRUCT_MAX_COMPILED)
+
+static struct struct_compiled table[COMPILED_SLOTS];
+static int ncompiled;
+
+/*
+ * one step of the plan of an id: count bytes copied between host_offset in
+ * the struct and wire_offset in the buffer, then reversed in elements of
+ * swap bytes if swap is not 0, or count zero pad bytes if pad is set.
+ */
+struct id_op {
+    int host_offset;
+    int wire_offset;
+    int count;
+    int swap;
+    int pad;
+};
+
+/* formats by id, with their generated code looked up once, or else the
+ * format scanned once into at most STRUCT_MAX_ID_OPS copies and swaps */
+struct format_id {
+    const char *fmt;
+    const struct struct_compiled *compiled;
+    struct id_op ops[STRUCT_MAX_ID_OPS];
+    int nops;               /* 0 if the format is interpreted */
+    int size;               /* packed size when planned */
+};
+
+static struct format_id ids[STRUCT_MAX_FORMAT_IDS];
+
+/* FNV-1a */
+static unsigned int hash_fmt(const char *fmt)
+{
+    uint32_t h = 2166136261u;
+
+    for (; *fmt != '\0'; fmt++) {
+        h = (h ^ (unsigned char)*fmt) * 16777619u;
+    }
+    return h;
+}
+
+static struct struct_compiled *slot_for(const char *fmt, unsigned int hash)
+{
+    struct struct_compiled *e;
+    unsigned int i;
+
+    for (i = hash % COMPILED_SLOTS; ; i = (i + 1) % COMPILED_SLOTS) {
+        e = &table[i];
+        if (e->fmt == NULL || e->fmt == fmt
+                || (e->hash == hash && strcmp(e->fmt, fmt) == 0)) {
+            return e;
+        }
+    }
+}
+
+/* look the generated code of every id up again after the table changed */
+static void resolve_ids(void)
+{
+    int i;
+
+    for (i = 0; i < STRUCT_MAX_FORMAT_IDS; i++) {
+        if (ids[i].fmt != NULL) {
+            ids[i].compiled = struct_compiled_find(ids[i].fmt);
+        }
+    }
+}
+
+/*
+ * struct_walk_runs() callback building the plan of an id. integers, strings
+ * and pad bytes only: they are as wide in the struct as packed, so a field is
+ * a copy plus a byte swap. floats go through the IEEE encoders and the other
+ * characters are not fixed-size.
+ */
+static int plan_run(void *arg, char endian, char c, int count,
+        size_t host_offset, size_t wire_offset)
+{
+    struct format_id *f = arg;
+    struct id_op *op;
+    int size = struct_wire_size(c);
+    int order = struct_get_endian();
+    int swap;
+
+    if (strchr("bBhHiIlLqQspx", c) == NULL
+            || (c != 'x' && struct_host_size(c) != size)) {
+        return -1;
+    }
+    if (endian == '<') {
+        order = STRUCT_ENDIAN_LITTLE;
+    } else if (endian == '>' || endian == '!') {
+        order = STRUCT_ENDIAN_BIG;
+    }
+    swap = (size > 1 && order != struct_get_endian()) ? size : 0;
+    count *= size;
+
+    /* extend the last step when both sides continue where it ended */
+    op = (f->nops > 0) ? &f->ops[f->nops - 1] : NULL;
+    if (op != NULL && op->pad == (c == 'x') && op->swap == swap
+            && op->wire_offset + op->count == (int)wire_offset
+            && (op->pad || op->host_offset + op->count == (int)host_offset)) {
+        op->count += count;
+        return 0;
+    }
+    if (f->nops == STRUCT_MAX_ID_OPS) {
+        return -1;
+    }
+    op = &f->ops[f->nops++];
+    op->host_offset = (int)host_offset;
+    op->wire_offset = (int)wire_offset;
+    op->count = count;
+    op->swap = swap;
+    op->pad = (c == 'x');
+    return 0;
+}
+
+static void plan_pack(const struct format_id *f, unsigned char *buf,
+        const unsigned char *src)
+{
+    const struct id_op *op;
+
+    for (op = f->ops; op < f->ops + f->nops; op++) {
+        if (op->pad) {
+            memset(buf + op->wire_offset, 0, op->count);
+            continue;
+        }
+        memcpy(buf + op->wire_offset, src + op->host_offset, op->count);
+        if (op->swap) {
+            struct_swap_elems(buf + op->wire_offset, op->swap,
+                    op->count / op->swap);
+        }
+    }
+}
+
+static void plan_unpack(const struct format_id *f, const unsigned char *buf,
+        unsigned char *dst)
+{
+    const struct id_op *op;
+
+    for (op = f->ops; op < f->ops + f->nops; op++) {
+        if (op->pad) {
+            continue;
+        }
+        memcpy(dst + op->host_offset, buf + op->wire_offset, op->count);
+        if (op->swap) {
+            struct_swap_elems(dst + op->host_offset, op->swap,
+                    op->count / op->swap);
+        }
+    }
+}
+
+/* the id prefix is an unsigned varint like 'V' */
+static int put_id(unsigned char *p, int len, unsigned int id)
+{
+    int n = 0;
+
+    for (; id >= 0x80; id >>= 7) {
+        if (n >= len) {
+            return -1;
+        }
+        p[n++] = (unsigned char)(id | 0x80);
+    }
+    if (n >= len) {
+        return -1;
+    }
+    p[n++] = (unsigned char)id;
+    return n;
+}
+
+/*
+ * only the shortest encoding put_id() writes is accepted, so every id has
+ * one prefix and a corrupted prefix cannot alias another id: no 0x00 last
+ * byte after the first and no bits shifted out of an unsigned int.
+ */
+static int get_id(const unsigned char *p, int len, unsigned int *id)
+{
+    unsigned int shift = 0;
+    int n = 0;
+
+    *id = 0;
+    for (;;) {
+        if (n >= len || shift > 28) {
+            return -1;
+        }
+        *id |= (unsigned int)(p[n] & 0x7f) << shift;
+        if ((p[n++] & 0x80) == 0) {
+            if ((n > 1 && p[n - 1] == 0)
+                    || (shift == 28 && p[n - 1] > 0x0f)) {
+                return -1;
+            }
+            return n;
+        }
+        shift += 7;
+    }
+}
+
+/*
+ * INTERNAL
+ *
+ */
+const struct struct_compiled *struct_compiled_find(const char *fmt)
+{
+    const struct struct_compiled *e;
+
+    if (ncompiled == 0) {
+        return NULL;
+    }
+    e = slot_for(fmt, hash_fmt(fmt));
+    return (e->fmt != NULL) ? e : NULL;
+}
+
+/*
+ * EXPORT
+ *
+ * preifx: struct_
+ *
+ */
+int struct_register(const char *fmt,
+        struct_pack_fn pack, struct_unpack_fn unpack)
+{
+    struct struct_compiled *e;
+    unsigned int hash;
+    int size;
+
+    size = struct_walk_runs(fmt, NULL, NULL);
+    if (size < 0 || pack == NULL || unpack == NULL) {
+        return -1;
+    }
+
+    hash = hash_fmt(fmt);
+    e = slot_for(fmt, hash);
+    if (e->fmt == NULL) {
+        if (ncompiled >= STRUCT_MAX_COMPILED) {
+            return -1;
+        }
+        ncompiled++;
+    }
+    e->fmt = fmt;
+    e->hash = hash;
+    e->size = size;
+    e->pack = pack;
+    e->unpack = unpack;
+    resolve_ids();
+    return 0;
+}
+
+void struct_unregister_all(void)
+{
+    memset(table, 0, sizeof(table));
+    ncompiled = 0;
+    resolve_ids();
+}
+
+int struct_register_id(int id, const char *fmt)
+{
+    struct_info_t info;
+
+    if (id < 0 || id >= STRUCT_MAX_FORMAT_IDS) {
+        return -1;
+    }
+    if (fmt != NULL) {
+        memset(&info, 0, sizeof(info));
+        if (struct_describe(fmt, &info) < 0) {
+            return -1;
+        }
+    }
+    ids[id].fmt = fmt;
+    ids[id].compiled = (fmt != NULL) ? struct_compiled_find(fmt) : NULL;
+    ids[id].nops = 0;
+    if (fmt != NULL) {
+        ids[id].size = struct_walk_runs(fmt, plan_run, &ids[id]);
+        if (ids[id].size < 0) {
+            ids[id].nops = 0; /* interpreted */
+        }
+    }
+    return 0;
+}
+
+const char *struct_id_format(int id)
+{
+    if (id < 0 || id >= STRUCT_MAX_FORMAT_IDS) {
+        return NULL;
+    }
+    return ids[id].fmt;
+}
+
+int struct_pack_id(void *buf, int buflen, int id, void *src)
+{
+    const struct struct_compiled *c;
+    int n;
+    int ret;
+
+    if (id < 0 || id >= STRUCT_MAX_FORMAT_IDS || ids[id].fmt == NULL) {
+        return -1;
+    }
+    n = put_id(buf, buflen, id);
+    if (n < 0) {
+        return -1;
+    }
+
+    c = ids[id].compiled;
+    if (c != NULL) {
+        if (buflen - n < c->size) {
+            return -1;
+        }
+        ret = c->pack((unsigned char *)buf + n, src);
+    } else if (ids[id].nops > 0) {
+        if (buflen - n < ids[id].size) {
+            return -1;
+        }
+        plan_pack(&ids[id], (unsigned char *)buf + n, src);
+        ret = ids[id].size;
+    } else {
+        ret = struct_pack_into(buf, buflen, n, ids[id].fmt, src);
+    }
+    return (ret < 0) ? -1 : n + ret;
+}
+
+int struct_unpack_any(const void *buf, int buflen, int *id, void *dst)
+{
+    const struct struct_compiled *c;
+    unsigned int i;
+    int n;
+    int ret;
+
+    n = get_id(buf, buflen, &i);
+    if (n < 0 || i >= STRUCT_MAX_FORMAT_IDS || ids[i].fmt == NULL) {
+        return -1;
+    }
+
+    c = ids[i].compiled;
+    if (c != NULL) {
+        if (buflen - n < c->size) {
+            return -1;
+        }
+        ret = c->unpack((const unsigned char *)buf + n, dst);
+    } else if (ids[i].nops > 0) {
+        if (buflen - n < ids[i].size) {
+            return -1;
+        }
+        plan_unpack(&ids[i], (const unsigned char *)buf + n, dst);
+        ret = ids[i].size;
+    } else {
+        ret = struct_unpack_from(buf, buflen, n, ids[i].fmt, dst);
+    }
+    if (ret < 0) {
+        return -1;
+    }
+    if (id != NULL) {
+        *id = (int)i;
+    }
+    return n + ret;
+}
@@ -0,0 +1,11 @@
+#ifndef STRUCT_CRC32C_INCLUDED
+#define STRUCT_CRC32C_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* CRC32C (Castagnoli) of len bytes, chained like zlib's crc32():
+ * start with crc = 0 and feed the previous result back in */
+extern uint32_t struct_crc32c(uint32_t crc, const void *buf, size_t len);
+
+#endif /* !STRUCT_CRC32C_INCLUDED */
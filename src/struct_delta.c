@@ -0,0 +1,247 @@
+#include "struct.h"
+#include "struct_delta.h"
+#include "struct_internal.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define DELTA_PATCH  0
+#define DELTA_STREAM 1
+
+struct delta {
+    int mode;
+    const unsigned char *prev;
+    const unsigned char *cur;
+    unsigned char *out;     /* packed buffer or delta stream */
+    int len;                /* DELTA_STREAM: size of out */
+    int pos;                /* DELTA_STREAM: bytes written */
+    int field;              /* index of the next field */
+    int changed;
+};
+
+/* first offset in [from, to) where a and b differ, to if there is none */
+static size_t diff_from(const unsigned char *a, const unsigned char *b,
+        size_t from, size_t to)
+{
+    uint64_t wa;
+    uint64_t wb;
+
+    while (from + sizeof(uint64_t) <= to) {
+        memcpy(&wa, a + from, sizeof(wa));
+        memcpy(&wb, b + from, sizeof(wb));
+        if (wa != wb) {
+            break;
+        }
+        from += sizeof(uint64_t);
+    }
+    while (from < to && a[from] == b[from]) {
+        from++;
+    }
+    return from;
+}
+
+/* number of fields in a run and their sizes */
+static int run_fields(char c, int count, int *host, int *wire, int *n)
+{
+    *host = struct_host_size(c);
+    *wire = struct_wire_size(c);
+    *n = count;
+    if (c == 'x') {
+        *n = 0;
+    } else if (c == 's' || c == 'p') {
+        *host *= count;
+        *wire *= count;
+        *n = 1;
+    }
+    return *n;
+}
+
+static int emit(struct delta *dt, uint64_t idx, char endian, char c,
+        int count, size_t host_offset, size_t wire_offset)
+{
+    char fmt[16];
+    int wire = struct_wire_size(c) * count;
+    int n;
+
+    snprintf(fmt, sizeof(fmt), "%c%d%c", endian, count, c);
+
+    if (dt->mode == DELTA_PATCH) {
+        n = struct_pack(dt->out + wire_offset, fmt,
+                (void *)(dt->cur + host_offset));
+        return (n < 0) ? -1 : 0;
+    }
+
+    if (dt->len - dt->pos < 10 + wire) {
+        return -1;
+    }
+    dt->pos += struct_pack(dt->out + dt->pos, "V", &idx);
+    n = struct_pack(dt->out + dt->pos, fmt, (void *)(dt->cur + host_offset));
+    if (n < 0) {
+        return -1;
+    }
+    dt->pos += n;
+    return 0;
+}
+
+static int delta_run(void *arg, char endian, char c, int count,
+        size_t host_offset, size_t wire_offset)
+{
+    struct delta *dt = arg;
+    size_t end;
+    size_t d;
+    int host;
+    int wire;
+    int n;
+    int i;
+
+    if (run_fields(c, count, &host, &wire, &n) == 0) {
+        return 0;
+    }
+
+    end = host_offset + (size_t)host * n;
+    for (i = 0; i < n; ) {
+        d = diff_from(dt->prev, dt->cur, host_offset + (size_t)host * i, end);
+        if (d == end) {
+            break;
+        }
+        /* jump straight to the field holding the difference */
+        i = (int)((d - host_offset) / host);
+        if (emit(dt, dt->field + i, endian, c, (n == 1) ? count : 1,
+                    host_offset + (size_t)host * i,
+                    wire_offset + (size_t)wire * i) < 0) {
+            return -1;
+        }
+        dt->changed++;
+        i++;
+    }
+    dt->field += n;
+    return 0;
+}
+
+struct apply {
+    unsigned char *dst;
+    const unsigned char *in;
+    int len;
+    int pos;
+    uint64_t next;          /* index of the next field in the stream */
+    int field;              /* index of the first field of the run */
+    int applied;
+};
+
+static int read_index(struct apply *ap)
+{
+    int i;
+
+    if (ap->pos >= ap->len) {
+        ap->next = UINT64_MAX;
+        return 0;
+    }
+    for (i = ap->pos; i < ap->len && i < ap->pos + 10; i++) {
+        if (!(ap->in[i] & 0x80)) {
+            break;
+        }
+    }
+    if (i == ap->len || i == ap->pos + 10) {
+        return -1;
+    }
+    ap->pos += struct_unpack(&ap->next, "V", (void *)(ap->in + ap->pos));
+    return 0;
+}
+
+static int apply_run(void *arg, char endian, char c, int count,
+        size_t host_offset, size_t wire_offset)
+{
+    struct apply *ap = arg;
+    char fmt[16];
+    uint64_t i;
+    int host;
+    int wire;
+    int n;
+
+    (void)wire_offset;
+
+    run_fields(c, count, &host, &wire, &n);
+    snprintf(fmt, sizeof(fmt), "%c%d%c", endian, (n == 1) ? count : 1, c);
+
+    while (ap->next >= (uint64_t)ap->field
+            && ap->next < (uint64_t)ap->field + n) {
+        i = ap->next - ap->field;
+        if (ap->len - ap->pos < wire) {
+            return -1;
+        }
+        struct_unpack(ap->dst + host_offset + host * i, fmt,
+                (void *)(ap->in + ap->pos));
+        ap->pos += wire;
+        ap->applied++;
+        if (read_index(ap) < 0) {
+            return -1;
+        }
+    }
+    ap->field += n;
+    return 0;
+}
+
+/*
+ * EXPORT
+ *
+ * preifx: struct_
+ *
+ */
+int struct_delta_patch(void *buf, const char *fmt,
+        const void *prev, const void *cur)
+{
+    struct delta dt;
+
+    memset(&dt, 0, sizeof(dt));
+    dt.mode = DELTA_PATCH;
+    dt.prev = prev;
+    dt.cur = cur;
+    dt.out = buf;
+
+    if (struct_walk_runs(fmt, delta_run, &dt) < 0) {
+        return -1;
+    }
+    return dt.changed;
+}
+
+int struct_delta_pack(void *buf, int len, const char *fmt,
+        const void *prev, const void *cur)
+{
+    struct delta dt;
+
+    memset(&dt, 0, sizeof(dt));
+    dt.mode = DELTA_STREAM;
+    dt.prev = prev;
+    dt.cur = cur;
+    dt.out = buf;
+    dt.len = len;
+
+    if (struct_walk_runs(fmt, delta_run, &dt) < 0) {
+        return -1;
+    }
+    return dt.pos;
+}
+
+int struct_delta_unpack(void *dst, const char *fmt,
+        const void *buf, int len)
+{
+    struct apply ap;
+
+    memset(&ap, 0, sizeof(ap));
+    ap.dst = dst;
+    ap.in = buf;
+    ap.len = len;
+
+    if (read_index(&ap) < 0) {
+        return -1;
+    }
+    if (struct_walk_runs(fmt, apply_run, &ap) < 0) {
+        return -1;
+    }
+    /* indexes out of order or past the last field */
+    if (ap.pos != ap.len || ap.next != UINT64_MAX) {
+        return -1;
+    }
+    return ap.applied;
+}
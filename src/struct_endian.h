@@ -1,10 +1,30 @@
-#ifndef STRUCT_ENDIAN_INCLUDED
-#define STRUCT_ENDIAN_INCLUDED
-
-#define STRUCT_ENDIAN_NOT_SET   0
-#define STRUCT_ENDIAN_BIG       1
-#define STRUCT_ENDIAN_LITTLE    2
-
-extern int struct_get_endian(void);
-
-#endif /* !STRUCT_ENDIAN_INCLUDED */
+#ifndef STRUCT_ENDIAN_INCLUDED
+#define STRUCT_ENDIAN_INCLUDED
+
+#define STRUCT_ENDIAN_NOT_SET   0
+#define STRUCT_ENDIAN_BIG       1
+#define STRUCT_ENDIAN_LITTLE    2
+
+extern int struct_get_endian(void);
+
+/* reverse the bytes of a 16, 32 or 64 bit value */
+#if defined(__GNUC__) || defined(__clang__)
+#define STRUCT_BSWAP16(x) __builtin_bswap16(x)
+#define STRUCT_BSWAP32(x) __builtin_bswap32(x)
+#define STRUCT_BSWAP64(x) __builtin_bswap64(x)
+#elif defined(_MSC_VER)
+#include <stdlib.h>
+#define STRUCT_BSWAP16(x) _byteswap_ushort(x)
+#define STRUCT_BSWAP32(x) _byteswap_ulong(x)
+#define STRUCT_BSWAP64(x) _byteswap_uint64(x)
+#else
+#define STRUCT_BSWAP16(x) ((uint16_t)((uint16_t)(x) >> 8 | (uint16_t)(x) << 8))
+#define STRUCT_BSWAP32(x) \
+    ((uint32_t)(STRUCT_BSWAP16((uint16_t)(x)) << 16 \
+        | STRUCT_BSWAP16((uint16_t)((x) >> 16))))
+#define STRUCT_BSWAP64(x) \
+    ((uint64_t)STRUCT_BSWAP32((uint32_t)(x)) << 32 \
+        | STRUCT_BSWAP32((uint32_t)((x) >> 32)))
+#endif
+
+#endif /* !STRUCT_ENDIAN_INCLUDED */
@@ -0,0 +1,167 @@
+#include "struct.h"
+#include "struct_frame.h"
+#include "struct_endian.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#define FRAME_HEADER_FMT "!BBHI"
+#define FRAME_VERSION 1
+
+struct header {
+    unsigned char order;
+    unsigned char version;
+    uint16_t id;
+    uint32_t count;
+};
+
+/*
+ * fmt behind the byte order of the frame, order is '<' or '>'.
+ * returns the size of a record of a fixed-size format, 0 if it varies.
+ */
+static int set_fmt(struct_frame_t *fr, char order, const char *fmt)
+{
+    struct_info_t info;
+
+    if (*fmt == '=' || *fmt == '<' || *fmt == '>' || *fmt == '!') {
+        fmt++;
+    }
+    if (strlen(fmt) > STRUCT_FRAME_MAX_FMT - 2) {
+        return -1;
+    }
+    fr->fmt[0] = order;
+    strcpy(fr->fmt + 1, fmt);
+
+    memset(&info, 0, sizeof(info));
+    if (struct_describe(fr->fmt, &info) < 0 || info.size == 0) {
+        return -1; /* an empty record would never end the frame */
+    }
+    return info.fixed ? info.size : 0;
+}
+
+static int read_header(const void *buf, int buflen, struct header *h)
+{
+    if (struct_unpack_from(buf, buflen, 0, FRAME_HEADER_FMT, h) < 0
+            || (h->order != '<' && h->order != '>')
+            || h->version != FRAME_VERSION || h->count > INT32_MAX) {
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * EXPORT
+ *
+ * preifx: struct_
+ *
+ */
+int struct_frame_begin(struct_frame_t *fr, void *buf, int buflen,
+        int id, char order, const char *fmt)
+{
+    if (buf == NULL || buflen < STRUCT_FRAME_HEADER_SIZE
+            || id < 0 || id > UINT16_MAX) {
+        return -1;
+    }
+    switch (order) {
+    case '=':
+        order = (struct_get_endian() == STRUCT_ENDIAN_LITTLE) ? '<' : '>';
+        break;
+    case '!':
+        order = '>';
+        break;
+    case '<': /* fall through */
+    case '>':
+        break;
+    default:
+        return -1;
+    }
+    if (set_fmt(fr, order, fmt) < 0) {
+        return -1;
+    }
+
+    fr->buf = buf;
+    fr->buflen = buflen;
+    fr->offset = STRUCT_FRAME_HEADER_SIZE;
+    fr->count = 0;
+    fr->id = id;
+    return 0;
+}
+
+int struct_frame_add(struct_frame_t *fr, void *src)
+{
+    int n;
+
+    n = struct_pack_into(fr->buf, fr->buflen, fr->offset, fr->fmt, src);
+    if (n < 0) {
+        return -1;
+    }
+    fr->offset += n;
+    fr->count++;
+    return n;
+}
+
+int struct_frame_end(struct_frame_t *fr)
+{
+    struct header h;
+
+    h.order = fr->fmt[0];
+    h.version = FRAME_VERSION;
+    h.id = fr->id;
+    h.count = fr->count;
+    struct_pack(fr->buf, FRAME_HEADER_FMT, &h);
+    return fr->offset;
+}
+
+int struct_frame_id(const void *buf, int buflen)
+{
+    struct header h;
+
+    if (read_header(buf, buflen, &h) < 0) {
+        return -1;
+    }
+    return h.id;
+}
+
+int struct_frame_open(struct_frame_t *fr, const void *buf, int buflen,
+        const char *fmt)
+{
+    struct header h;
+    int size;
+
+    if (read_header(buf, buflen, &h) < 0) {
+        return -1;
+    }
+    size = set_fmt(fr, h.order, fmt);
+    if (size < 0) {
+        return -1;
+    }
+    /* a count the buffer cannot hold, variable records fail in next() */
+    if (size > 0 && h.count > (uint32_t)(buflen - STRUCT_FRAME_HEADER_SIZE)
+            / size) {
+        return -1;
+    }
+
+    fr->buf = (void *)buf;
+    fr->buflen = buflen;
+    fr->offset = STRUCT_FRAME_HEADER_SIZE;
+    fr->count = (int)h.count;
+    fr->id = h.id;
+    return 0;
+}
+
+int struct_frame_next(struct_frame_t *fr, void *dst)
+{
+    int n;
+
+    if (fr->count == 0) {
+        return 0;
+    }
+
+    n = struct_unpack_from(fr->buf, fr->buflen, fr->offset, fr->fmt, dst);
+    if (n <= 0) {
+        return -1;
+    }
+    fr->offset += n;
+    fr->count--;
+    return n;
+}
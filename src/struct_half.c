@@ -0,0 +1,181 @@
+#include "struct_half.h"
+
+#if defined(__F16C__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+#include <string.h>
+
+static uint16_t float_to_half(float f)
+{
+    uint32_t x;
+    uint32_t sign;
+    uint32_t absx;
+    uint32_t h;
+    uint32_t m;
+    uint32_t rem;
+    uint32_t tie;
+    int shift;
+
+    memcpy(&x, &f, sizeof(x));
+    sign = (x >> 16) & 0x8000;
+    absx = x & 0x7fffffff;
+
+    if (absx >= 0x7f800000) {
+        /* inf, or nan keeping the top of the payload and made quiet */
+        if (absx == 0x7f800000) {
+            return sign | 0x7c00;
+        }
+        return sign | 0x7c00 | 0x200 | ((absx >> 13) & 0x3ff);
+    }
+
+    if (absx >= 0x477ff000) {
+        return sign | 0x7c00; /* 65520 and up round to inf */
+    }
+
+    if (absx < 0x38800000) {
+        /* below 2^-14: subnormal or zero */
+        if (absx < 0x33000000) {
+            return sign;
+        }
+        m = (absx & 0x7fffff) | 0x800000;
+        shift = 126 - (int)(absx >> 23);
+        h = m >> shift;
+        rem = m & ((1u << shift) - 1);
+        tie = 1u << (shift - 1);
+        if (rem > tie || (rem == tie && (h & 1))) {
+            h++;
+        }
+        return sign | h;
+    }
+
+    /* rebias the exponent from 127 to 15, a carry out of the significand
+     * correctly bumps the exponent */
+    h = (absx - 0x38000000) >> 13;
+    rem = absx & 0x1fff;
+    if (rem > 0x1000 || (rem == 0x1000 && (h & 1))) {
+        h++;
+    }
+    return sign | h;
+}
+
+static float half_to_float(uint16_t h)
+{
+    uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    uint32_t e = (h >> 10) & 0x1f;
+    uint32_t m = h & 0x3ff;
+    uint32_t x;
+    float f;
+
+    if (e == 0) {
+        if (m == 0) {
+            x = sign;
+        } else {
+            /* subnormal, normalize it */
+            e = 113;
+            while (!(m & 0x400)) {
+                m <<= 1;
+                e--;
+            }
+            x = sign | (e << 23) | ((m & 0x3ff) << 13);
+        }
+    } else if (e == 31) {
+        x = sign | 0x7f800000 | (m << 13);
+        if (m != 0) {
+            x |= 0x400000; /* quiet nan */
+        }
+    } else {
+        x = sign | ((e + 112) << 23) | (m << 13);
+    }
+
+    memcpy(&f, &x, sizeof(f));
+    return f;
+}
+
+static uint16_t float_to_bfloat16(float f)
+{
+    uint32_t x;
+
+    memcpy(&x, &f, sizeof(x));
+    if ((x & 0x7fffffff) > 0x7f800000) {
+        return (x >> 16) | 0x40; /* quiet nan */
+    }
+    x += 0x7fff + ((x >> 16) & 1);
+    return x >> 16;
+}
+
+static float bfloat16_to_float(uint16_t h)
+{
+    uint32_t x = (uint32_t)h << 16;
+    float f;
+
+    memcpy(&f, &x, sizeof(f));
+    return f;
+}
+
+void struct_float_to_half(uint16_t *dst, const float *src, size_t n)
+{
+    size_t i = 0;
+
+#if defined(__AVX512F__)
+    for (; i + 16 <= n; i += 16) {
+        _mm256_storeu_si256((__m256i *)(dst + i),
+                _mm512_cvtps_ph(_mm512_loadu_ps(src + i),
+                    _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+    }
+#endif
+#if defined(__F16C__)
+    for (; i + 8 <= n; i += 8) {
+        _mm_storeu_si128((__m128i *)(dst + i),
+                _mm256_cvtps_ph(_mm256_loadu_ps(src + i),
+                    _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+    }
+#endif
+    for (; i < n; i++) {
+        dst[i] = float_to_half(src[i]);
+    }
+}
+
+void struct_half_to_float(float *dst, const uint16_t *src, size_t n)
+{
+    size_t i = 0;
+
+#if defined(__AVX512F__)
+    for (; i + 16 <= n; i += 16) {
+        _mm512_storeu_ps(dst + i, _mm512_cvtph_ps(
+                    _mm256_loadu_si256((const __m256i *)(src + i))));
+    }
+#endif
+#if defined(__F16C__)
+    for (; i + 8 <= n; i += 8) {
+        _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(
+                    _mm_loadu_si128((const __m128i *)(src + i))));
+    }
+#endif
+    for (; i < n; i++) {
+        dst[i] = half_to_float(src[i]);
+    }
+}
+
+/*
+ * the bfloat16 loops are plain integer code that compilers vectorize. the
+ * AVX512-BF16 instruction is not used since it flushes subnormals and would
+ * change the packed bits.
+ */
+void struct_float_to_bfloat16(uint16_t *dst, const float *src, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        dst[i] = float_to_bfloat16(src[i]);
+    }
+}
+
+void struct_bfloat16_to_float(float *dst, const uint16_t *src, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        dst[i] = bfloat16_to_float(src[i]);
+    }
+}
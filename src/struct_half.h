@@ -0,0 +1,15 @@
+#ifndef STRUCT_HALF_INCLUDED
+#define STRUCT_HALF_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* IEEE 754 binary16 and bfloat16 conversions of n values, rounding to
+ * nearest even. every build produces the same bits, with or without the
+ * vector instructions. */
+extern void struct_float_to_half(uint16_t *dst, const float *src, size_t n);
+extern void struct_half_to_float(float *dst, const uint16_t *src, size_t n);
+extern void struct_float_to_bfloat16(uint16_t *dst, const float *src, size_t n);
+extern void struct_bfloat16_to_float(float *dst, const uint16_t *src, size_t n);
+
+#endif /* !STRUCT_HALF_INCLUDED */
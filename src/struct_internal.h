@@ -0,0 +1,42 @@
+#ifndef STRUCT_INTERNAL_INCLUDED
+#define STRUCT_INTERNAL_INCLUDED
+
+/* bytes one element of format character c takes in the source struct,
+ * -1 if c is not a value character */
+extern int struct_host_size(int c);
+
+/* bytes one element of format character c takes in the packed buffer,
+ * -1 if the size is variable or c is not a value character */
+extern int struct_wire_size(int c);
+
+#include <stddef.h>
+
+/* called for every run of one format character, e.g. once for '4h'.
+ * endian is the byte order character in effect ('=' if none was given).
+ * for 's' and 'p' count is the length of the string. */
+typedef int (*struct_run_fn)(void *arg, char endian, char c, int count,
+        size_t host_offset, size_t wire_offset);
+
+/* walk a fixed-size format, groups with a fixed count are walked as many
+ * times as they repeat. fn may be NULL.
+ * returns the packed size, -1 if the format is not fixed-size or fn failed */
+extern int struct_walk_runs(const char *fmt, struct_run_fn fn, void *arg);
+
+/* reverse the bytes of count elements of size 2, 4 or 8 at p in place */
+extern void struct_swap_elems(void *p, int size, long count);
+
+#include "struct_compiled.h"
+
+/* generated code registered with struct_register() */
+struct struct_compiled {
+    const char *fmt;
+    unsigned int hash;
+    int size;               /* packed size */
+    struct_pack_fn pack;
+    struct_unpack_fn unpack;
+};
+
+/* the generated code registered for fmt, NULL if there is none */
+extern const struct struct_compiled *struct_compiled_find(const char *fmt);
+
+#endif /* !STRUCT_INTERNAL_INCLUDED */
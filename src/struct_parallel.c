@@ -0,0 +1,307 @@
+#include "struct.h"
+#include "struct_parallel.h"
+#include "struct_internal.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifndef STRUCT_PARALLEL_THRESHOLD
+#define STRUCT_PARALLEL_THRESHOLD (64 * 1024)
+#endif
+
+#ifndef STRUCT_PARALLEL_CHUNK
+#define STRUCT_PARALLEL_CHUNK (16 * 1024)
+#endif
+
+#ifndef STRUCT_PARALLEL_MAX_CHUNKS
+#define STRUCT_PARALLEL_MAX_CHUNKS 256
+#endif
+
+/* one piece of the record, packed with its own small format */
+struct chunk {
+    char fmt[16];
+    size_t host_offset;
+    size_t wire_offset;
+};
+
+struct struct_pool {
+    pthread_t *threads;
+    int nthreads;
+    int threshold;
+
+    pthread_mutex_t busy;   /* one record at a time */
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t done;
+    unsigned long gen;      /* bumped for every record */
+    int active;             /* workers still looking at the record */
+    int stop;
+
+    /* the record being converted */
+    int unpack;
+    unsigned char *buf;
+    unsigned char *src;
+    struct chunk chunks[STRUCT_PARALLEL_MAX_CHUNKS];
+    int nchunks;
+    atomic_int next;
+    atomic_int finished;
+    atomic_int failed;
+};
+
+static int add_chunk(struct struct_pool *pool, char endian, char c, int count,
+        size_t host_offset, size_t wire_offset)
+{
+    struct chunk *ch;
+
+    if (pool->nchunks >= STRUCT_PARALLEL_MAX_CHUNKS) {
+        return -1;
+    }
+    ch = &pool->chunks[pool->nchunks++];
+    snprintf(ch->fmt, sizeof(ch->fmt), "%c%d%c", endian, count, c);
+    ch->host_offset = host_offset;
+    ch->wire_offset = wire_offset;
+    return 0;
+}
+
+struct split {
+    struct struct_pool *pool;
+    long chunk_bytes;
+};
+
+/* cut one run into pieces of about chunk_bytes */
+static int split_run(void *arg, char endian, char c, int count,
+        size_t host_offset, size_t wire_offset)
+{
+    struct split *sp = arg;
+    int host = struct_host_size(c);
+    int wire = struct_wire_size(c);
+    int per_chunk = (int)(sp->chunk_bytes / wire);
+    int n;
+
+    if (per_chunk < 1) {
+        per_chunk = 1;
+    }
+    while (count > 0) {
+        n = (count < per_chunk) ? count : per_chunk;
+        if (add_chunk(sp->pool, endian, c, n, host_offset, wire_offset) < 0) {
+            return -1;
+        }
+        host_offset += (size_t)n * host;
+        wire_offset += (size_t)n * wire;
+        count -= n;
+    }
+    return 0;
+}
+
+static void run_chunks(struct struct_pool *pool)
+{
+    struct chunk *ch;
+    int i;
+    int ret;
+
+    while ((i = atomic_fetch_add(&pool->next, 1)) < pool->nchunks) {
+        ch = &pool->chunks[i];
+        if (pool->unpack) {
+            ret = struct_unpack(pool->src + ch->host_offset, ch->fmt,
+                    pool->buf + ch->wire_offset);
+        } else {
+            ret = struct_pack(pool->buf + ch->wire_offset, ch->fmt,
+                    pool->src + ch->host_offset);
+        }
+        if (ret < 0) {
+            atomic_store(&pool->failed, 1);
+        }
+        atomic_fetch_add(&pool->finished, 1);
+    }
+}
+
+static void *worker(void *arg)
+{
+    struct struct_pool *pool = arg;
+    unsigned long seen = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->stop && pool->gen == seen) {
+            pthread_cond_wait(&pool->wake, &pool->lock);
+        }
+        if (pool->stop) {
+            break;
+        }
+        seen = pool->gen;
+        pool->active++;
+        pthread_mutex_unlock(&pool->lock);
+
+        run_chunks(pool);
+
+        pthread_mutex_lock(&pool->lock);
+        pool->active--;
+        pthread_cond_broadcast(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+/*
+ * @return the packed size, or -2 if the record should be converted by the
+ * calling thread alone.
+ */
+static int run_parallel(struct struct_pool *pool, int unpack,
+        unsigned char *buf, const char *fmt, unsigned char *src)
+{
+    struct split sp;
+    long size;
+    int ret;
+
+    size = struct_walk_runs(fmt, NULL, NULL);
+    if (size < 0 || size < pool->threshold) {
+        return -2;
+    }
+
+    pthread_mutex_lock(&pool->busy);
+
+    /* late workers may still be looking at the previous record */
+    pthread_mutex_lock(&pool->lock);
+    while (pool->active > 0) {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+
+    sp.pool = pool;
+    sp.chunk_bytes = size / (STRUCT_PARALLEL_MAX_CHUNKS / 2) + 1;
+    if (sp.chunk_bytes < STRUCT_PARALLEL_CHUNK) {
+        sp.chunk_bytes = STRUCT_PARALLEL_CHUNK;
+    }
+    pool->nchunks = 0;
+    if (struct_walk_runs(fmt, split_run, &sp) < 0) {
+        pthread_mutex_unlock(&pool->lock);
+        pthread_mutex_unlock(&pool->busy);
+        return -2;
+    }
+    pool->unpack = unpack;
+    pool->buf = buf;
+    pool->src = src;
+    atomic_store(&pool->next, 0);
+    atomic_store(&pool->finished, 0);
+    atomic_store(&pool->failed, 0);
+    pool->gen++;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    run_chunks(pool);
+
+    pthread_mutex_lock(&pool->lock);
+    while (atomic_load(&pool->finished) < pool->nchunks) {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    ret = atomic_load(&pool->failed) ? -1 : (int)size;
+    pthread_mutex_unlock(&pool->lock);
+
+    pthread_mutex_unlock(&pool->busy);
+    return ret;
+}
+
+/*
+ * EXPORT
+ *
+ * preifx: struct_
+ *
+ */
+struct_pool_t *struct_pool_create(int nthreads)
+{
+    struct struct_pool *pool;
+    int i;
+
+    if (nthreads < 1) {
+        return NULL;
+    }
+
+    pool = calloc(1, sizeof(*pool));
+    if (pool == NULL) {
+        return NULL;
+    }
+    pool->threads = calloc(nthreads, sizeof(pthread_t));
+    if (pool->threads == NULL) {
+        free(pool);
+        return NULL;
+    }
+    pool->threshold = STRUCT_PARALLEL_THRESHOLD;
+    pthread_mutex_init(&pool->busy, NULL);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    for (i = 0; i < nthreads; i++) {
+        if (pthread_create(&pool->threads[i], NULL, worker, pool) != 0) {
+            break;
+        }
+        pool->nthreads++;
+    }
+    if (pool->nthreads == 0) {
+        struct_pool_destroy(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+void struct_pool_destroy(struct_pool_t *pool)
+{
+    int i;
+
+    if (pool == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (i = 0; i < pool->nthreads; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    pthread_cond_destroy(&pool->done);
+    pthread_cond_destroy(&pool->wake);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_mutex_destroy(&pool->busy);
+    free(pool->threads);
+    free(pool);
+}
+
+void struct_pool_set_threshold(struct_pool_t *pool, int bytes)
+{
+    if (pool != NULL) {
+        pool->threshold = bytes;
+    }
+}
+
+int struct_pack_parallel(struct_pool_t *pool,
+        void *buf, const char *fmt, void *src)
+{
+    int ret;
+
+    if (pool != NULL) {
+        ret = run_parallel(pool, 0, buf, fmt, src);
+        if (ret != -2) {
+            return ret;
+        }
+    }
+    return struct_pack(buf, fmt, src);
+}
+
+int struct_unpack_parallel(struct_pool_t *pool,
+        const void *buf, const char *fmt, void *src)
+{
+    int ret;
+
+    if (pool != NULL) {
+        /* buf is the destination struct, like in struct_unpack() */
+        ret = run_parallel(pool, 1, src, fmt, (unsigned char *)buf);
+        if (ret != -2) {
+            return ret;
+        }
+    }
+    return struct_unpack(buf, fmt, src);
+}
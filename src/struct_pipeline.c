@@ -0,0 +1,674 @@
+#include "struct.h"
+#include "struct_pipeline.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#if defined(__linux__) && !defined(STRUCT_PIPELINE_NO_URING) \
+    && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define HAVE_URING 1
+#endif
+#endif
+#endif
+
+#define BUF_FREE    0
+#define BUF_READING 1
+#define BUF_READY   2
+
+/* user_data of cancel requests, buffers use their index, or'ed with
+ * POLL_TAG while they wait for data */
+#define CANCEL_TAG UINT64_MAX
+#define POLL_TAG ((uint64_t)1 << 32)
+
+struct buffer {
+    unsigned char *data;
+    struct iovec iov;   /* io_uring: the part still to be read */
+    int want;           /* bytes asked for */
+    int len;            /* bytes read */
+    off_t offset;       /* file offset of data[0], regular files only */
+    int state;
+    int eof;            /* the stream ended in this buffer */
+    int err;            /* errno of a failed read */
+    int polling;        /* io_uring: waiting for a non-blocking fd */
+};
+
+#ifdef HAVE_URING
+struct uring {
+    int fd;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_entries;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ptr;
+    void *cq_ptr;
+    size_t sq_len;
+    size_t cq_len;
+    size_t sqes_len;
+    unsigned queued;    /* sqes not yet passed to the kernel */
+};
+#endif
+
+struct struct_pipeline {
+    const char *fmt;
+    int size;           /* packed record */
+    int host_size;      /* unpacked record */
+    int batch;
+    int depth;
+    struct buffer *bufs;
+    unsigned char *records;     /* batch + 1 unpacked records */
+    unsigned char *carry;       /* start of a record split between buffers */
+    int carry_len;
+
+    /* state of a run */
+    int fd;
+    int seekable;
+    off_t next_offset;          /* offset of the next read */
+    unsigned long next_fill;    /* buffers are filled and consumed in order */
+    unsigned long next_consume;
+    int eof_seen;               /* no more reads are started */
+    int inflight;
+
+    /* I/O thread when there is no io_uring */
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int stop;
+    int io_done;
+};
+
+/*
+ * unpack the records of one buffer and hand them out.
+ * returns 0 to go on, 1 if fn stopped, -1 if a record does not unpack.
+ */
+static int consume(struct struct_pipeline *pl, struct buffer *b,
+        struct_batch_fn fn, void *arg, long *count)
+{
+    int off = 0;
+    int n = 0;
+    int k;
+
+    if (pl->carry_len > 0) {
+        k = pl->size - pl->carry_len;
+        k = (k < b->len) ? k : b->len;
+        memcpy(pl->carry + pl->carry_len, b->data, k);
+        pl->carry_len += k;
+        off = k;
+        if (pl->carry_len == pl->size) {
+            if (struct_unpack_from(pl->carry, pl->size, 0, pl->fmt,
+                        pl->records) < 0) {
+                return -1;
+            }
+            n++;
+            pl->carry_len = 0;
+        }
+    }
+    for (; b->len - off >= pl->size; off += pl->size, n++) {
+        if (struct_unpack_from(b->data, b->len, off, pl->fmt,
+                    pl->records + (size_t)n * pl->host_size) < 0) {
+            return -1;
+        }
+    }
+    if (off < b->len) {
+        memcpy(pl->carry + pl->carry_len, b->data + off, b->len - off);
+        pl->carry_len += b->len - off;
+    }
+
+    if (n == 0) {
+        return 0;
+    }
+    *count += n;
+    return (fn(arg, pl->records, n) != 0) ? 1 : 0;
+}
+
+static void start_buffer(struct struct_pipeline *pl, struct buffer *b)
+{
+    b->want = pl->batch * pl->size;
+    b->len = 0;
+    b->offset = pl->next_offset;
+    b->eof = 0;
+    b->err = 0;
+    b->polling = 0;
+    b->state = BUF_READING;
+    if (pl->seekable) {
+        pl->next_offset += b->want;
+    }
+}
+
+/*
+ * a read returned res bytes, or -errno. returns 1 if b is now ready, the
+ * caller then sets pl->eof_seen if b->eof or b->err is set.
+ */
+static int read_done(struct struct_pipeline *pl, struct buffer *b, long res)
+{
+    if (res < 0) {
+        if (res == -EINTR || res == -EAGAIN) {
+            return 0; /* read again */
+        }
+        b->err = (int)-res;
+    } else if (res == 0) {
+        b->eof = 1;
+    } else {
+        b->len += (int)res;
+        /* files are read in fixed slices, finish the slice */
+        if (pl->seekable && b->len < b->want) {
+            return 0;
+        }
+    }
+    b->state = BUF_READY;
+    return 1;
+}
+
+#ifdef HAVE_URING
+static int uring_setup(struct uring *ring, unsigned entries)
+{
+    struct io_uring_params p;
+
+    memset(ring, 0, sizeof(*ring));
+    memset(&p, 0, sizeof(p));
+    ring->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+    if (ring->fd < 0) {
+        return -1;
+    }
+
+    ring->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ring->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_len > ring->sq_len) {
+            ring->sq_len = ring->cq_len;
+        }
+        ring->cq_len = 0;
+    }
+    ring->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+
+    ring->sq_ptr = mmap(NULL, ring->sq_len, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ptr == MAP_FAILED) {
+        close(ring->fd);
+        return -1;
+    }
+    ring->cq_ptr = ring->sq_ptr;
+    if (ring->cq_len > 0) {
+        ring->cq_ptr = mmap(NULL, ring->cq_len, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ptr == MAP_FAILED) {
+            munmap(ring->sq_ptr, ring->sq_len);
+            close(ring->fd);
+            return -1;
+        }
+    }
+    ring->sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        if (ring->cq_len > 0) {
+            munmap(ring->cq_ptr, ring->cq_len);
+        }
+        munmap(ring->sq_ptr, ring->sq_len);
+        close(ring->fd);
+        return -1;
+    }
+
+    ring->sq_head = (unsigned *)((char *)ring->sq_ptr + p.sq_off.head);
+    ring->sq_tail = (unsigned *)((char *)ring->sq_ptr + p.sq_off.tail);
+    ring->sq_mask = (unsigned *)((char *)ring->sq_ptr + p.sq_off.ring_mask);
+    ring->sq_entries = (unsigned *)((char *)ring->sq_ptr
+            + p.sq_off.ring_entries);
+    ring->sq_array = (unsigned *)((char *)ring->sq_ptr + p.sq_off.array);
+    ring->cq_head = (unsigned *)((char *)ring->cq_ptr + p.cq_off.head);
+    ring->cq_tail = (unsigned *)((char *)ring->cq_ptr + p.cq_off.tail);
+    ring->cq_mask = (unsigned *)((char *)ring->cq_ptr + p.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)((char *)ring->cq_ptr
+            + p.cq_off.cqes);
+    return 0;
+}
+
+static void uring_close(struct uring *ring)
+{
+    munmap(ring->sqes, ring->sqes_len);
+    if (ring->cq_len > 0) {
+        munmap(ring->cq_ptr, ring->cq_len);
+    }
+    munmap(ring->sq_ptr, ring->sq_len);
+    close(ring->fd);
+}
+
+/* pass the queued requests to the kernel and wait for wait completions */
+static int uring_enter(struct uring *ring, unsigned wait)
+{
+    long ret;
+
+    do {
+        ret = syscall(__NR_io_uring_enter, ring->fd, ring->queued, wait,
+                wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    } while (ret < 0 && errno == EINTR);
+    if (ret < 0) {
+        return -1;
+    }
+    ring->queued -= (unsigned)ret;
+    return 0;
+}
+
+static unsigned uring_sq_used(struct uring *ring)
+{
+    return *ring->sq_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+}
+
+/* the next free sqe, NULL if the submission queue stays full */
+static struct io_uring_sqe *uring_sqe(struct uring *ring)
+{
+    struct io_uring_sqe *sqe;
+    unsigned tail;
+    unsigned idx;
+
+    if (uring_sq_used(ring) >= *ring->sq_entries) {
+        /* hand the queued requests to the kernel to free their slots */
+        if (ring->queued == 0 || uring_enter(ring, 0) < 0
+                || uring_sq_used(ring) >= *ring->sq_entries) {
+            return NULL;
+        }
+    }
+    tail = *ring->sq_tail;
+    idx = tail & *ring->sq_mask;
+    sqe = &ring->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_array[idx] = idx;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ring->queued++;
+    return sqe;
+}
+
+/* a request for b could not be queued, hand b out as failed */
+static void uring_fail(struct struct_pipeline *pl, struct buffer *b)
+{
+    b->err = EBUSY;
+    b->state = BUF_READY;
+    pl->eof_seen = 1;
+    pl->inflight--;
+}
+
+static int uring_read(struct uring *ring, struct struct_pipeline *pl,
+        struct buffer *b)
+{
+    struct io_uring_sqe *sqe = uring_sqe(ring);
+
+    if (sqe == NULL) {
+        return -1;
+    }
+    b->iov.iov_base = b->data + b->len;
+    b->iov.iov_len = b->want - b->len;
+    sqe->opcode = IORING_OP_READV;
+    sqe->fd = pl->fd;
+    sqe->addr = (uint64_t)(uintptr_t)&b->iov;
+    sqe->len = 1;
+    sqe->off = pl->seekable ? (uint64_t)(b->offset + b->len) : 0;
+    sqe->user_data = (uint64_t)(b - pl->bufs);
+    return 0;
+}
+
+/* wait until a non-blocking fd has data before reading again */
+static int uring_poll(struct uring *ring, struct struct_pipeline *pl,
+        struct buffer *b)
+{
+    struct io_uring_sqe *sqe = uring_sqe(ring);
+
+    if (sqe == NULL) {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = pl->fd;
+    sqe->poll_events = POLLIN;
+    sqe->user_data = (uint64_t)(b - pl->bufs) | POLL_TAG;
+    b->polling = 1;
+    return 0;
+}
+
+static void uring_reap(struct uring *ring, struct struct_pipeline *pl)
+{
+    unsigned head = *ring->cq_head;
+    unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+    struct io_uring_cqe *cqe;
+    struct buffer *b;
+
+    for (; head != tail; head++) {
+        cqe = &ring->cqes[head & *ring->cq_mask];
+        if (cqe->user_data == CANCEL_TAG) {
+            continue;
+        }
+        b = &pl->bufs[cqe->user_data & ~POLL_TAG];
+        b->polling = 0;
+        if (pl->stop) {
+            /* cancelled or not, nothing is read on once stopped */
+            b->state = BUF_READY;
+            b->err = ECANCELED;
+            pl->inflight--;
+        } else if (cqe->user_data & POLL_TAG) {
+            if (cqe->res < 0 && cqe->res != -EINTR) {
+                b->err = -cqe->res;
+                b->state = BUF_READY;
+                pl->eof_seen = 1;
+                pl->inflight--;
+            } else if (uring_read(ring, pl, b) < 0) {
+                uring_fail(pl, b);
+            }
+        } else if (cqe->res == -EAGAIN) {
+            /* the kernel does not wait on O_NONBLOCK fds, poll instead of
+             * reading again right away */
+            if (uring_poll(ring, pl, b) < 0) {
+                uring_fail(pl, b);
+            }
+        } else if (read_done(pl, b, cqe->res)) {
+            pl->eof_seen |= b->eof || b->err;
+            pl->inflight--;
+        } else if (uring_read(ring, pl, b) < 0) {
+            uring_fail(pl, b);
+        }
+    }
+    __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+}
+
+static int run_uring(struct struct_pipeline *pl,
+        struct_batch_fn fn, void *arg, long *count)
+{
+    struct uring ring;
+    struct io_uring_sqe *sqe;
+    struct buffer *b;
+    int ret = 0;
+    int i;
+
+    if (uring_setup(&ring, 2 * pl->depth) < 0) {
+        return -2;
+    }
+
+    for (;;) {
+        /* regular files get depth reads in flight, streams one */
+        while (!pl->eof_seen
+                && pl->inflight < (pl->seekable ? pl->depth : 1)) {
+            b = &pl->bufs[pl->next_fill % pl->depth];
+            if (b->state != BUF_FREE) {
+                break;
+            }
+            start_buffer(pl, b);
+            pl->next_fill++;
+            pl->inflight++;
+            if (uring_read(&ring, pl, b) < 0) {
+                uring_fail(pl, b);
+            }
+        }
+
+        b = &pl->bufs[pl->next_consume % pl->depth];
+        if (b->state != BUF_READY) {
+            if (pl->inflight == 0) {
+                break; /* end of the stream */
+            }
+            if (uring_enter(&ring, 1) < 0) {
+                ret = -1;
+                break;
+            }
+            uring_reap(&ring, pl);
+            continue;
+        }
+        /* let the kernel read ahead while this buffer is unpacked */
+        if (ring.queued > 0 && uring_enter(&ring, 0) < 0) {
+            ret = -1;
+            break;
+        }
+
+        ret = b->err ? -1 : consume(pl, b, fn, arg, count);
+        b->state = BUF_FREE;
+        pl->next_consume++;
+        if (ret != 0) {
+            break;
+        }
+    }
+
+    /* stopped early, the kernel must be done with the buffers */
+    pl->stop = 1;
+    if (pl->inflight > 0) {
+        for (i = 0; i < pl->depth; i++) {
+            if (pl->bufs[i].state == BUF_READING) {
+                sqe = uring_sqe(&ring);
+                if (sqe == NULL) {
+                    break; /* wait for the reads to finish */
+                }
+                sqe->opcode = IORING_OP_ASYNC_CANCEL;
+                sqe->fd = -1;
+                sqe->addr = (uint64_t)i | (pl->bufs[i].polling ? POLL_TAG : 0);
+                sqe->user_data = CANCEL_TAG;
+            }
+        }
+        while (pl->inflight > 0 && uring_enter(&ring, 1) == 0) {
+            uring_reap(&ring, pl);
+        }
+    }
+    uring_close(&ring);
+    return ret;
+}
+#endif /* HAVE_URING */
+
+/*
+ * fill b with one read, or as many as a slice of a file takes. b is a copy
+ * private to the I/O thread, only pl->fd and pl->seekable are read from pl.
+ */
+static void read_buffer(struct struct_pipeline *pl, struct buffer *b)
+{
+    struct pollfd pfd;
+    ssize_t res;
+
+    do {
+        if (pl->seekable) {
+            res = pread(pl->fd, b->data + b->len, b->want - b->len,
+                    b->offset + b->len);
+        } else {
+            res = read(pl->fd, b->data + b->len, b->want - b->len);
+        }
+        if (res < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            /* non-blocking socket, wait until there is data */
+            pfd.fd = pl->fd;
+            pfd.events = POLLIN;
+            poll(&pfd, 1, -1);
+        }
+    } while (!read_done(pl, b, (res < 0) ? -errno : (long)res));
+}
+
+static void *io_thread(void *arg)
+{
+    struct struct_pipeline *pl = arg;
+    struct buffer *b;
+    struct buffer r;
+
+    pthread_mutex_lock(&pl->lock);
+    for (;;) {
+        b = &pl->bufs[pl->next_fill % pl->depth];
+        while (!pl->stop && b->state != BUF_FREE) {
+            pthread_cond_wait(&pl->cond, &pl->lock);
+        }
+        if (pl->stop || pl->eof_seen) {
+            break;
+        }
+        start_buffer(pl, b);
+        r = *b;
+        pthread_mutex_unlock(&pl->lock);
+
+        /* the consumer polls b->state under the lock, read into a copy and
+         * publish it with the lock held */
+        read_buffer(pl, &r);
+
+        pthread_mutex_lock(&pl->lock);
+        *b = r;
+        pl->eof_seen |= r.eof || r.err;
+        pl->next_fill++;
+        pthread_cond_broadcast(&pl->cond);
+    }
+    pl->io_done = 1;
+    pthread_cond_broadcast(&pl->cond);
+    pthread_mutex_unlock(&pl->lock);
+    return NULL;
+}
+
+static int run_thread(struct struct_pipeline *pl,
+        struct_batch_fn fn, void *arg, long *count)
+{
+    pthread_t thread;
+    struct buffer *b;
+    int ret = 0;
+
+    if (pthread_create(&thread, NULL, io_thread, pl) != 0) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&pl->lock);
+    for (;;) {
+        b = &pl->bufs[pl->next_consume % pl->depth];
+        while (b->state != BUF_READY && !pl->io_done) {
+            pthread_cond_wait(&pl->cond, &pl->lock);
+        }
+        if (b->state != BUF_READY) {
+            break; /* end of the stream */
+        }
+        pthread_mutex_unlock(&pl->lock);
+
+        ret = b->err ? -1 : consume(pl, b, fn, arg, count);
+
+        pthread_mutex_lock(&pl->lock);
+        b->state = BUF_FREE;
+        pl->next_consume++;
+        pthread_cond_broadcast(&pl->cond);
+        if (ret != 0) {
+            break;
+        }
+    }
+    pl->stop = 1;
+    pthread_cond_broadcast(&pl->cond);
+    pthread_mutex_unlock(&pl->lock);
+
+    pthread_join(thread, NULL);
+    return ret;
+}
+
+/*
+ * EXPORT
+ *
+ * preifx: struct_
+ *
+ */
+struct_pipeline_t *struct_pipeline_create(const char *fmt,
+        int batch, int depth)
+{
+    struct struct_pipeline *pl;
+    struct_info_t info;
+    int i;
+
+    memset(&info, 0, sizeof(info));
+    if (struct_describe(fmt, &info) < 0 || !info.fixed || info.size <= 0
+            || info.host_size <= 0
+            || batch < 1 || depth < 2 || batch > INT32_MAX / info.size) {
+        return NULL;
+    }
+
+    pl = calloc(1, sizeof(*pl));
+    if (pl == NULL) {
+        return NULL;
+    }
+    pthread_mutex_init(&pl->lock, NULL);
+    pthread_cond_init(&pl->cond, NULL);
+    pl->fmt = fmt;
+    pl->size = info.size;
+    pl->host_size = info.host_size;
+    pl->batch = batch;
+    pl->depth = depth;
+    pl->bufs = calloc(depth, sizeof(struct buffer));
+    pl->records = malloc((size_t)(batch + 1) * info.host_size + 1);
+    pl->carry = malloc(info.size);
+    if (pl->bufs == NULL || pl->records == NULL || pl->carry == NULL) {
+        struct_pipeline_destroy(pl);
+        return NULL;
+    }
+    for (i = 0; i < depth; i++) {
+        pl->bufs[i].data = malloc((size_t)batch * info.size);
+        if (pl->bufs[i].data == NULL) {
+            struct_pipeline_destroy(pl);
+            return NULL;
+        }
+    }
+    return pl;
+}
+
+void struct_pipeline_destroy(struct_pipeline_t *pl)
+{
+    int i;
+
+    if (pl == NULL) {
+        return;
+    }
+    if (pl->bufs != NULL) {
+        for (i = 0; i < pl->depth; i++) {
+            free(pl->bufs[i].data);
+        }
+    }
+    pthread_cond_destroy(&pl->cond);
+    pthread_mutex_destroy(&pl->lock);
+    free(pl->bufs);
+    free(pl->records);
+    free(pl->carry);
+    free(pl);
+}
+
+long struct_pipeline_run(struct_pipeline_t *pl, int fd,
+        struct_batch_fn fn, void *arg)
+{
+    struct stat st;
+    long count = 0;
+    off_t start;
+    int ret = -2;
+    int i;
+
+    start = lseek(fd, 0, SEEK_CUR);
+    pl->fd = fd;
+    pl->seekable = start >= 0 && fstat(fd, &st) == 0
+        && (S_ISREG(st.st_mode) || S_ISBLK(st.st_mode));
+    pl->next_offset = pl->seekable ? start : 0;
+    pl->next_fill = 0;
+    pl->next_consume = 0;
+    pl->eof_seen = 0;
+    pl->inflight = 0;
+    pl->stop = 0;
+    pl->io_done = 0;
+    pl->carry_len = 0;
+    for (i = 0; i < pl->depth; i++) {
+        pl->bufs[i].state = BUF_FREE;
+    }
+
+#ifdef HAVE_URING
+    ret = run_uring(pl, fn, arg, &count);
+#endif
+    if (ret == -2) {
+        ret = run_thread(pl, fn, arg, &count);
+    }
+
+    if (pl->seekable) {
+        /* leave the offset after the records handed out, a partial record
+         * in pl->carry was not consumed */
+        lseek(fd, start + (off_t)count * pl->size, SEEK_SET);
+    }
+    if (ret < 0 || (ret == 0 && pl->carry_len > 0)) {
+        return -1;
+    }
+    return count;
+}
@@ -0,0 +1,176 @@
+#include "struct.h"
+#include "struct_ring.h"
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define CACHE_LINE 64
+
+/*
+ * bounded queue after Dmitry Vyukov: the sequence number of a slot tells
+ * whose turn it is. seq == pos: free for the producer holding ticket pos,
+ * seq == pos + 1: holds a record for the consumer at pos.
+ */
+struct slot {
+    atomic_size_t seq;
+    int len;
+};
+
+struct struct_ring {
+    atomic_size_t tail;     /* next ticket for producers */
+    char pad0[CACHE_LINE - sizeof(atomic_size_t)];
+    size_t head;            /* next position for the consumer */
+    char pad1[CACHE_LINE - sizeof(size_t)];
+
+    const char *fmt;
+    int size;
+    size_t mask;
+    struct slot *slots;
+    unsigned char *data;
+};
+
+/*
+ * EXPORT
+ *
+ * preifx: struct_
+ *
+ */
+struct_ring_t *struct_ring_create(const char *fmt, int capacity)
+{
+    struct struct_ring *ring;
+    size_t n = 1;
+    size_t i;
+    int size;
+
+    size = struct_calcsize(fmt);
+    if (size <= 0 || capacity < 1) {
+        return NULL;
+    }
+    while (n < (size_t)capacity) {
+        n <<= 1;
+    }
+
+    ring = calloc(1, sizeof(*ring));
+    if (ring == NULL) {
+        return NULL;
+    }
+    ring->slots = calloc(n, sizeof(struct slot));
+    ring->data = malloc(n * size);
+    if (ring->slots == NULL || ring->data == NULL) {
+        struct_ring_destroy(ring);
+        return NULL;
+    }
+
+    ring->fmt = fmt;
+    ring->size = size;
+    ring->mask = n - 1;
+    for (i = 0; i < n; i++) {
+        atomic_init(&ring->slots[i].seq, i);
+    }
+    atomic_init(&ring->tail, 0);
+    return ring;
+}
+
+void struct_ring_destroy(struct_ring_t *ring)
+{
+    if (ring == NULL) {
+        return;
+    }
+    free(ring->data);
+    free(ring->slots);
+    free(ring);
+}
+
+int struct_ring_record_size(const struct_ring_t *ring)
+{
+    return ring->size;
+}
+
+void *struct_ring_reserve(struct_ring_t *ring)
+{
+    struct slot *s;
+    size_t pos;
+    size_t seq;
+    intptr_t dif;
+
+    pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    for (;;) {
+        s = &ring->slots[pos & ring->mask];
+        seq = atomic_load_explicit(&s->seq, memory_order_acquire);
+        dif = (intptr_t)seq - (intptr_t)pos;
+        if (dif == 0) {
+            if (atomic_compare_exchange_weak_explicit(&ring->tail, &pos,
+                        pos + 1, memory_order_relaxed, memory_order_relaxed)) {
+                return ring->data + (pos & ring->mask) * ring->size;
+            }
+        } else if (dif < 0) {
+            return NULL; /* full, the consumer has not released it yet */
+        } else {
+            pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        }
+    }
+}
+
+void struct_ring_commit(struct_ring_t *ring, void *slot, int len)
+{
+    size_t i = ((unsigned char *)slot - ring->data) / ring->size;
+    struct slot *s = &ring->slots[i];
+    size_t pos = atomic_load_explicit(&s->seq, memory_order_relaxed);
+
+    s->len = len;
+    atomic_store_explicit(&s->seq, pos + 1, memory_order_release);
+}
+
+int struct_ring_push(struct_ring_t *ring, void *src)
+{
+    void *slot;
+    int len;
+
+    slot = struct_ring_reserve(ring);
+    if (slot == NULL) {
+        return -1;
+    }
+    len = struct_pack_into(slot, ring->size, 0, ring->fmt, src);
+    /* commit even on failure, the consumer sees a record of length -1 */
+    struct_ring_commit(ring, slot, len);
+    return len;
+}
+
+const void *struct_ring_peek(struct_ring_t *ring, int *len)
+{
+    struct slot *s = &ring->slots[ring->head & ring->mask];
+    size_t seq = atomic_load_explicit(&s->seq, memory_order_acquire);
+
+    if (seq != ring->head + 1) {
+        return NULL;
+    }
+    if (len != NULL) {
+        *len = s->len;
+    }
+    return ring->data + (ring->head & ring->mask) * ring->size;
+}
+
+void struct_ring_release(struct_ring_t *ring)
+{
+    struct slot *s = &ring->slots[ring->head & ring->mask];
+
+    atomic_store_explicit(&s->seq, ring->head + ring->mask + 1,
+            memory_order_release);
+    ring->head++;
+}
+
+int struct_ring_pop(struct_ring_t *ring, void *dst)
+{
+    const void *p;
+    int len;
+    int ret;
+
+    p = struct_ring_peek(ring, &len);
+    if (p == NULL) {
+        return 0;
+    }
+    ret = (len < 0) ? -1 : struct_unpack_from(p, len, 0, ring->fmt, dst);
+    struct_ring_release(ring);
+    return ret;
+}
@@ -0,0 +1,223 @@
+/*
+ * fuzz_struct.c
+ *
+ * Fuzz target for the format interpreter, for libFuzzer, AFL++ or a plain
+ * sanitizer build, see the Makefile.
+ *
+ * The input is a format string, a NUL byte and the bytes to unpack. Every
+ * format goes through struct_describe() and struct_calcsize(), which must
+ * agree on fixed-size formats, and the bytes go through unpack -> pack ->
+ * unpack -> pack. The first pack normalizes the input (NaN payloads, pad
+ * bytes, varint and 'r' widths), so both packs must produce the same bytes,
+ * and no step may write past the buffers it was given.
+ *
+ * Without libFuzzer (-DSTRUCT_FUZZ_MAIN) the program runs the files given as
+ * arguments, or stdin for AFL++, or with -r N seed N random inputs.
+ */
+#include "struct.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_FMT 64
+#define MAX_HOST (1 << 16)
+#define MAX_WIRE 4096
+#define MAX_ELEMS (1 << 20)
+
+static unsigned char host1[MAX_HOST];
+static unsigned char host2[MAX_HOST];
+
+static void fail(const char *what, const char *fmt)
+{
+    fprintf(stderr, "%s: \"%s\"\n", what, fmt);
+    abort();
+}
+
+/*
+ * counts are walked element by element and groups repetition by repetition,
+ * so e.g. '3333(3333(3333B))' is valid but only costs time. skip formats
+ * expanding to more than MAX_ELEMS elements.
+ */
+static int too_large(const char *fmt)
+{
+    double mult[16];
+    double work = 0;
+    double n = 0;
+    int depth = 0;
+
+    mult[0] = 1;
+    for (; *fmt != '\0'; fmt++) {
+        if (*fmt >= '0' && *fmt <= '9') {
+            n = n * 10 + (*fmt - '0');
+            continue;
+        }
+        if (*fmt == '(') {
+            if (depth == 15) {
+                return 1;
+            }
+            mult[depth + 1] = mult[depth] * ((n > 0) ? n : 1);
+            depth++;
+        } else if (*fmt == ')') {
+            depth -= (depth > 0);
+        } else {
+            work += mult[depth] * ((n > 0) ? n : 1);
+        }
+        n = 0;
+        if (work > MAX_ELEMS || mult[depth] > MAX_ELEMS) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    struct_field_t fields[8];
+    struct_info_t info;
+    char fmt[MAX_FMT + 1];
+    unsigned char *in;
+    unsigned char *wire1;
+    unsigned char *wire2;
+    size_t flen;
+    int len;
+    int size1;
+    int size2;
+    int n;
+
+    flen = 0;
+    while (flen < size && flen < MAX_FMT && data[flen] != '\0') {
+        flen++;
+    }
+    memcpy(fmt, data, flen);
+    fmt[flen] = '\0';
+    data += (flen < size) ? flen + 1 : flen;
+    size -= (flen < size) ? flen + 1 : flen;
+    len = (size < MAX_WIRE) ? (int)size : MAX_WIRE;
+    if (too_large(fmt)) {
+        return 0;
+    }
+
+    memset(&info, 0, sizeof(info));
+    info.fields = fields;
+    info.max_fields = 8;
+    n = struct_describe(fmt, &info);
+    if (n < 0) {
+        return 0;
+    }
+    if (info.fixed && struct_calcsize(fmt) != info.size) {
+        fail("calcsize and describe disagree", fmt);
+    }
+    if (info.host_size < 0 || info.host_size > MAX_HOST) {
+        return 0;
+    }
+
+    /* exact-sized buffers so the sanitizers see any overrun */
+    in = malloc(len + 1);
+    wire1 = malloc(MAX_WIRE);
+    if (in == NULL || wire1 == NULL) {
+        abort();
+    }
+    memcpy(in, data, len);
+    wire2 = NULL;
+
+    memset(host1, 0, info.host_size);
+    n = struct_unpack_from(in, len, 0, fmt, host1);
+    if (n > len) {
+        fail("unpack read past the buffer", fmt);
+    }
+    if (n >= 0) {
+        if (info.size >= 0 && n > info.size) {
+            fail("unpacked more than the maximum size", fmt);
+        }
+        size1 = struct_pack_into(wire1, MAX_WIRE, 0, fmt, host1);
+        if (size1 < 0) {
+            fail("cannot pack what was unpacked", fmt);
+        }
+        wire2 = malloc(size1 + 1);
+        if (wire2 == NULL) {
+            abort();
+        }
+        memset(host2, 0, info.host_size);
+        if (struct_unpack_from(wire1, size1, 0, fmt, host2) != size1) {
+            fail("cannot unpack what was packed", fmt);
+        }
+        size2 = struct_pack_into(wire2, size1, 0, fmt, host2);
+        if (size2 != size1 || memcmp(wire1, wire2, size1) != 0) {
+            fail("pack is not stable", fmt);
+        }
+        /* one byte short must fail, not overrun */
+        if (size1 > 0 && struct_pack_into(wire2, size1 - 1, 0, fmt,
+                    host2) >= 0) {
+            fail("pack fits into a short buffer", fmt);
+        }
+    }
+
+    free(in);
+    free(wire1);
+    free(wire2);
+    return 0;
+}
+
+#ifdef STRUCT_FUZZ_MAIN
+static const char alphabet[] = "=<>!bBhHiIlLqQfdeEspxvVtzr()#0123456789";
+
+static int run_file(FILE *fp)
+{
+    static uint8_t buf[MAX_FMT + 1 + MAX_WIRE];
+    size_t n;
+
+    n = fread(buf, 1, sizeof(buf), fp);
+    return LLVMFuzzerTestOneInput(buf, n);
+}
+
+static void run_random(long iters, unsigned int seed)
+{
+    static uint8_t buf[MAX_FMT + 1 + 512];
+    long it;
+    int flen;
+    int len;
+    int i;
+
+    srand(seed);
+    for (it = 0; it < iters; it++) {
+        flen = rand() % 24 + 1;
+        for (i = 0; i < flen; i++) {
+            buf[i] = (rand() % 2) ? alphabet[rand() % (sizeof(alphabet) - 1)]
+                : "0123"[rand() % 4];
+        }
+        buf[flen] = '\0';
+        len = rand() % 512;
+        for (i = 0; i < len; i++) {
+            buf[flen + 1 + i] = (uint8_t)rand();
+        }
+        LLVMFuzzerTestOneInput(buf, flen + 1 + len);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    FILE *fp;
+    int i;
+
+    if (argc > 1 && strcmp(argv[1], "-r") == 0) {
+        run_random((argc > 2) ? atol(argv[2]) : 100000,
+                (argc > 3) ? (unsigned int)atoi(argv[3]) : 1);
+        return 0;
+    }
+    if (argc == 1) {
+        return run_file(stdin);
+    }
+    for (i = 1; i < argc; i++) {
+        fp = fopen(argv[i], "rb");
+        if (fp == NULL) {
+            perror(argv[i]);
+            return 1;
+        }
+        run_file(fp);
+        fclose(fp);
+    }
+    return 0;
+}
+#endif /* STRUCT_FUZZ_MAIN */
@@ -0,0 +1,126 @@
+#!/usr/bin/env python3
+#
+# gen_vectors.py
+#
+# Write vectors/cpython.txt from CPython's struct module, replayed by
+# test_vectors.c. The output is deterministic, re-run it only when adding
+# cases:
+#
+#   python3 gen_vectors.py > vectors/cpython.txt
+#
+import math
+import random
+import struct
+import sys
+
+INT_MAX = 2**31 - 1
+
+# the C type of each code as CPython packs it little-endian with '<'
+HOST = {'b': 'b', 'B': 'B', 'h': 'h', 'H': 'H', 'i': 'i', 'I': 'I',
+        'l': 'l', 'L': 'L', 'q': 'q', 'Q': 'Q', 'f': 'f', 'd': 'd',
+        'e': 'f', 's': 's'}
+
+# edge cases: signed zero, subnormals, NaN, infinities, limits
+SPECIAL = {
+    'b': [-128, -1, 0, 127],
+    'B': [0, 255],
+    'h': [-32768, -1, 32767],
+    'H': [0, 65535],
+    'i': [-2**31, -1, 2**31 - 1],
+    'I': [0, 2**32 - 1],
+    'l': [-2**31, -1, 2**31 - 1],
+    'L': [0, 2**32 - 1],
+    'q': [-2**63, -1, 2**63 - 1],
+    'Q': [0, 2**64 - 1],
+    'f': [0.0, -0.0, 1.401298464324817e-45, -1.1754942106924411e-38,
+          1.1754943508222875e-38, 3.4028234663852886e+38, math.inf,
+          -math.inf, math.nan],
+    'd': [0.0, -0.0, 5e-324, -2.225073858507201e-308,
+          2.2250738585072014e-308, 1.7976931348623157e+308, math.inf,
+          -math.inf, math.nan],
+    'e': [0.0, -0.0, 5.960464477539063e-08, -6.097555160522461e-05,
+          6.103515625e-05, 65504.0, math.inf, -math.inf, math.nan],
+}
+
+# sizes around INT_MAX, struct_calcsize() fails where CPython's does not fit
+CALCSIZE = ['<i', '<2147483647B', '<2147483648B', '<1073741823H',
+            '<1073741824H', '<536870911I', '<536870912I', '<268435455Q',
+            '<268435456Q', '<2147483647B1B', '<99999999999I', '<4294967296B',
+            '<4294967297B', '<1073741823H2B', '<1073741823H1B']
+
+
+def value(c):
+    if c in 'bhilq':
+        bits = {'b': 8, 'h': 16, 'i': 32, 'l': 32, 'q': 64}[c]
+        return random.randint(-2**(bits - 1), 2**(bits - 1) - 1)
+    if c in 'BHILQ':
+        bits = {'B': 8, 'H': 16, 'I': 32, 'L': 32, 'Q': 64}[c]
+        return random.randint(0, 2**bits - 1)
+    if c in 'fd':
+        n = 4 if c == 'f' else 8
+        while True:
+            x = struct.unpack('<' + c, random.randbytes(n))[0]
+            if x == x:
+                return x
+    if c == 'e':
+        while True:
+            x = struct.unpack('<e', random.randbytes(2))[0]
+            if x == x:
+                return x
+    raise ValueError(c)
+
+
+def line(fmt, items):
+    host = '<'
+    vals = []
+    for c, k, v in items:
+        if c == 'x':
+            continue
+        if c == 's':
+            host += '%ds' % k
+        else:
+            host += '%d%s' % (k, HOST[c])
+        vals += v
+    src = struct.pack(host, *vals)
+    packed = struct.pack(fmt, *vals)
+    return 'P %s %s %s' % (fmt, src.hex() or '-', packed.hex() or '-')
+
+
+def main():
+    random.seed(36)
+    out = ['# generated by gen_vectors.py from CPython %s, do not edit'
+           % sys.version.split()[0],
+           '# P fmt host packed: struct_pack() of host gives packed and',
+           '#   struct_unpack() of packed gives host, host is little-endian',
+           '# C fmt size: struct_calcsize(), -1 when the size is not an int']
+
+    for c, vals in SPECIAL.items():
+        for order in '<>':
+            for v in vals:
+                out.append(line(order + c, [(c, 1, [v])]))
+
+    for _ in range(1000):
+        order = random.choice('<>!')
+        items = []
+        for _ in range(random.randint(1, 6)):
+            c = random.choice('bBhHiIlLqQfdesx')
+            k = random.randint(1, 4)
+            if c == 's':
+                items.append((c, k, [random.randbytes(k)]))
+            elif c == 'x':
+                items.append((c, k, []))
+            else:
+                items.append((c, k, [value(c) for _ in range(k)]))
+        fmt = order + ''.join(
+            ('%d' % k if k > 1 or c == 's' else '') + c for c, k, v in items)
+        out.append(line(fmt, items))
+
+    for fmt in CALCSIZE:
+        size = struct.calcsize(fmt)
+        out.append('C %s %d' % (fmt, size if size <= INT_MAX else -1))
+
+    print('\n'.join(out))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,124 @@
+/*
+ * test_arrays.c
+ *
+ * 'z' and 'r' integer arrays must unpack to the values packed, for every
+ * bit width of the 'r' differences and for lengths around the 128 value
+ * blocks, 'r' blocks must take the size the format promises (16 * width
+ * bytes when full), and buffers one byte short must be refused.
+ */
+#include "struct.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_N 400
+
+static int failures;
+
+static uint64_t rand64(void)
+{
+    return (uint64_t)rand() << 42 ^ (uint64_t)rand() << 21 ^ (uint64_t)rand()
+        ^ (uint64_t)rand() << 62;
+}
+
+static int varint_size(int64_t val)
+{
+    uint64_t u = (val < 0) ? ~((uint64_t)val << 1) : (uint64_t)val << 1;
+    int n = 1;
+
+    for (; u >= 0x80; u >>= 7) {
+        n++;
+    }
+    return n;
+}
+
+/*
+ * src[0] random and the differences min plus width random bits, or, when
+ * exact, min plus all width bits set for the last difference of each block
+ * and min for the others, so every block has that minimum and width.
+ */
+static void fill(int64_t *src, int n, int width, int64_t min, int exact)
+{
+    uint64_t mask = (width < 64) ? ((uint64_t)1 << width) - 1 : ~0ull;
+    uint64_t d;
+    int i;
+
+    src[0] = (int64_t)rand64();
+    for (i = 1; i < n; i++) {
+        if (!exact) {
+            d = rand64() & mask;
+        } else {
+            d = (i % 128 == 0) ? mask : 0;
+        }
+        src[i] = (int64_t)((uint64_t)src[i - 1] + (uint64_t)min + d);
+    }
+}
+
+static void check(char c, const int64_t *src, int n, int want)
+{
+    static unsigned char buf[MAX_N * 11];
+    int64_t back[MAX_N];
+    char fmt[16];
+    int len;
+
+    snprintf(fmt, sizeof(fmt), "<%d%c", n, c);
+    len = struct_pack(buf, fmt, (void *)src);
+    if (len < 0 || (want >= 0 && len != want)) {
+        printf("\"%s\": packed %d bytes, want %d\n", fmt, len, want);
+        failures++;
+        return;
+    }
+    memset(back, 0x5a, sizeof(back));
+    if (struct_unpack(back, fmt, buf) != len
+            || memcmp(back, src, n * sizeof(int64_t)) != 0) {
+        printf("\"%s\": values differ after unpacking\n", fmt);
+        failures++;
+    }
+    if (struct_pack_into(buf, len - 1, 0, fmt, (void *)src) >= 0) {
+        printf("\"%s\": packed into %d bytes\n", fmt, len - 1);
+        failures++;
+    }
+    if (struct_unpack_from(buf, len - 1, 0, fmt, back) >= 0) {
+        printf("\"%s\": unpacked from %d bytes\n", fmt, len - 1);
+        failures++;
+    }
+}
+
+int main(void)
+{
+    static const int lengths[] = { 1, 2, 3, 9, 127, 128, 129, 130, 257, 385 };
+    int64_t src[MAX_N];
+    int64_t min;
+    int width;
+    int want;
+    int n;
+    int i;
+
+    for (i = 0; i < (int)(sizeof(lengths) / sizeof(lengths[0])); i++) {
+        n = lengths[i];
+        for (width = 0; width <= 64; width++) {
+            min = (int64_t)(rand64() >> 40) - ((int64_t)1 << 23);
+            fill(src, n, width, min, 0);
+            check('z', src, n, -1);
+            check('r', src, n, -1);
+
+            /* only full blocks: the first value, then per block the
+             * minimum, the width byte and 16 * width bytes. the minimum is
+             * -2^(width - 1) so min + 2^width - 1 does not overflow */
+            if ((n - 1) % 128 != 0) {
+                continue;
+            }
+            min = -(int64_t)(((width < 64) ? ((uint64_t)1 << width) - 1
+                        : ~0ull) >> 1) - 1;
+            fill(src, n, width, min, 1);
+            want = varint_size(src[0])
+                + (n - 1) / 128 * (varint_size(min) + 1 + 16 * width);
+            check('r', src, n, want);
+        }
+    }
+
+    printf("%d failures\n", failures);
+    return failures != 0;
+}
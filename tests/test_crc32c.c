@@ -0,0 +1,153 @@
+/*
+ * test_crc32c.c
+ *
+ * struct_crc32c() against the standard check value and a bitwise reference,
+ * and the struct_pack_crc32c()/struct_unpack_crc32c() trailer: a round trip,
+ * every single-bit error detected, and the trailer written in the byte order
+ * active at the end of the format.
+ *
+ * The Makefile builds it once per variant the host can run: slice-by-8, the
+ * table-less loop (-DSTRUCT_CRC32C_SMALL) and the SSE4.2 or ARMv8 crc32c
+ * instructions.
+ */
+#include "struct.h"
+#include "struct_crc32c.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int failures;
+
+#pragma pack(1)
+struct rec {
+    uint8_t a;
+    uint16_t b;
+    uint32_t c;
+    uint64_t d;
+};
+#pragma pack()
+
+static uint32_t reference(const unsigned char *p, size_t len)
+{
+    uint32_t c = 0xffffffff;
+    int k;
+
+    for (; len > 0; len--) {
+        c ^= *p++;
+        for (k = 0; k < 8; k++) {
+            c = (c >> 1) ^ (0x82F63B78 & (0 - (c & 1)));
+        }
+    }
+    return ~c;
+}
+
+static void test_crc(void)
+{
+    unsigned char buf[300];
+    uint32_t c;
+    size_t len;
+    size_t off;
+    size_t i;
+
+    c = struct_crc32c(0, "123456789", 9);
+    if (c != 0xE3069283) {
+        printf("crc32c(\"123456789\") = %08x, want e3069283\n", c);
+        failures++;
+    }
+    c = struct_crc32c(struct_crc32c(0, "1234", 4), "56789", 5);
+    if (c != 0xE3069283) {
+        printf("chained crc32c = %08x, want e3069283\n", c);
+        failures++;
+    }
+
+    /* every length and alignment around the 8 byte steps */
+    for (i = 0; i < sizeof(buf); i++) {
+        buf[i] = (unsigned char)rand();
+    }
+    for (off = 0; off < 8; off++) {
+        for (len = 0; len + off <= sizeof(buf); len += 7) {
+            c = struct_crc32c(0, buf + off, len);
+            if (c != reference(buf + off, len)) {
+                printf("crc32c of %d bytes at %d = %08x, want %08x\n",
+                        (int)len, (int)off, c, reference(buf + off, len));
+                failures++;
+            }
+        }
+    }
+}
+
+static void test_trailer(void)
+{
+    struct rec r = { 0x12, 0x3456, 0x789abcde, 0x0123456789abcdefULL };
+    struct rec back;
+    unsigned char buf[32];
+    unsigned char *t;
+    uint32_t c;
+    int n;
+    int i;
+
+    n = struct_pack_crc32c(buf, "!BHIQ", &r);
+    if (n != 15 + 4) {
+        printf("struct_pack_crc32c(\"!BHIQ\") = %d, want 19\n", n);
+        failures++;
+        return;
+    }
+    memset(&back, 0, sizeof(back));
+    if (struct_unpack_crc32c(&back, "!BHIQ", buf) != n
+            || memcmp(&back, &r, sizeof(r)) != 0) {
+        printf("struct_unpack_crc32c(\"!BHIQ\") does not round-trip\n");
+        failures++;
+    }
+
+    /* any single flipped bit, in the data or the trailer, is caught */
+    for (i = 0; i < n * 8; i++) {
+        buf[i / 8] ^= (unsigned char)(1 << (i % 8));
+        if (struct_unpack_crc32c(&back, "!BHIQ", buf) != -1) {
+            printf("bit %d flipped, struct_unpack_crc32c() accepts it\n", i);
+            failures++;
+        }
+        buf[i / 8] ^= (unsigned char)(1 << (i % 8));
+    }
+
+    /* the trailer follows the byte order in effect at the end */
+    c = struct_crc32c(0, buf, 15);
+    t = buf + 15;
+    if (t[0] != (c >> 24) || t[1] != ((c >> 16) & 0xff)
+            || t[2] != ((c >> 8) & 0xff) || t[3] != (c & 0xff)) {
+        printf("\"!BHIQ\" trailer is not big-endian\n");
+        failures++;
+    }
+    n = struct_pack_crc32c(buf, "!BH<IQ", &r);
+    c = struct_crc32c(0, buf, 15);
+    if (n != 19 || t[0] != (c & 0xff) || t[1] != ((c >> 8) & 0xff)
+            || t[2] != ((c >> 16) & 0xff) || t[3] != (c >> 24)) {
+        printf("\"!BH<IQ\" trailer is not little-endian\n");
+        failures++;
+    }
+    if (struct_unpack_crc32c(&back, "!BH<IQ", buf) != n
+            || memcmp(&back, &r, sizeof(r)) != 0) {
+        printf("struct_unpack_crc32c(\"!BH<IQ\") does not round-trip\n");
+        failures++;
+    }
+}
+
+int main(void)
+{
+#if defined(__SSE4_2__)
+    printf("SSE4.2 crc32c\n");
+#elif defined(__ARM_FEATURE_CRC32)
+    printf("ARMv8 crc32c\n");
+#elif defined(STRUCT_CRC32C_SMALL)
+    printf("table-less crc32c\n");
+#else
+    printf("slice-by-8 crc32c\n");
+#endif
+    srand(1);
+    test_crc();
+    test_trailer();
+
+    printf("%d failures\n", failures);
+    return failures != 0;
+}
@@ -0,0 +1,131 @@
+/*
+ * test_delta.c
+ *
+ * struct_delta_patch(), struct_delta_pack() and struct_delta_unpack(): the
+ * changed fields of a record patched into its packed form or sent as a delta
+ * stream and applied to the earlier record must give the same bytes and
+ * values as packing the new record, an unchanged record gives an empty
+ * delta, and a truncated or garbled stream is rejected with -1.
+ */
+#include "struct.h"
+#include "struct_delta.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define FMT "!8sB2xH2IQ"
+
+static int failures;
+
+#pragma pack(1)
+struct rec {
+    char name[8];
+    uint8_t flags;
+    uint16_t port;
+    uint32_t addr[2];
+    uint64_t counter;
+};
+#pragma pack()
+
+static void expect(int ok, const char *what, int got, int want)
+{
+    if (!ok) {
+        printf("%s: got %d, want %d\n", what, got, want);
+        failures++;
+    }
+}
+
+/* patch the packed prev into cur and send cur as a delta against prev */
+static void check(const char *what, const struct rec *prev,
+        const struct rec *cur, int changed)
+{
+    unsigned char buf[64];
+    unsigned char want[64];
+    unsigned char delta[128];
+    struct rec r;
+    int size;
+    int n;
+
+    size = struct_pack(want, FMT, (void *)cur);
+    struct_pack(buf, FMT, (void *)prev);
+    n = struct_delta_patch(buf, FMT, prev, cur);
+    expect(n == changed && memcmp(buf, want, size) == 0, what, n, changed);
+
+    n = struct_delta_pack(delta, sizeof(delta), FMT, prev, cur);
+    if (n < 0) {
+        expect(0, what, n, 0);
+        return;
+    }
+    r = *prev;
+    expect(struct_delta_unpack(&r, FMT, delta, n) == changed
+            && memcmp(&r, cur, sizeof(r)) == 0, what, n, changed);
+}
+
+int main(void)
+{
+    struct rec r0 = { "node-1", 1, 80, { 0x0a000001, 0x0a000002 }, 1 };
+    struct rec r1;
+    struct rec r2;
+    struct rec r;
+    unsigned char delta[128];
+    int len;
+    int n;
+
+    /* unchanged: nothing is patched, the stream is empty */
+    check("unchanged", &r0, &r0, 0);
+    expect(struct_delta_pack(delta, sizeof(delta), FMT, &r0, &r0) == 0,
+            "empty stream", 1, 0);
+
+    /* fields are numbered name 0, flags 1, port 2, addr 3 and 4, counter 5 */
+    r1 = r0;
+    r1.port = 8080;
+    r1.addr[1] = 0x0a0000ff;
+    check("port and addr[1]", &r0, &r1, 2);
+    n = struct_delta_pack(delta, sizeof(delta), FMT, &r0, &r1);
+    expect(n == 1 + 2 + 1 + 4 && delta[0] == 2 && delta[3] == 4,
+            "stream of port and addr[1]", n, 8);
+
+    /* a chain of deltas, each against the record before */
+    r2 = r1;
+    memcpy(r2.name, "node-22", 8);
+    r2.counter = 0x0102030405060708ULL;
+    check("name and counter", &r1, &r2, 2);
+    r = r0;
+    n = struct_delta_pack(delta, sizeof(delta), FMT, &r0, &r1);
+    struct_delta_unpack(&r, FMT, delta, n);
+    n = struct_delta_pack(delta, sizeof(delta), FMT, &r1, &r2);
+    struct_delta_unpack(&r, FMT, delta, n);
+    expect(memcmp(&r, &r2, sizeof(r)) == 0, "chained deltas", 0, 0);
+
+    /* a stream that does not fit */
+    n = struct_delta_pack(delta, n - 1, FMT, &r1, &r2);
+    expect(n == -1, "short stream buffer", n, -1);
+
+    /* truncated inside a field, or inside an index */
+    len = struct_delta_pack(delta, sizeof(delta), FMT, &r0, &r1);
+    r = r0;
+    n = struct_delta_unpack(&r, FMT, delta, len - 1);
+    expect(n == -1, "truncated field", n, -1);
+    delta[len] = 0x80;
+    n = struct_delta_unpack(&r, FMT, delta, len + 1);
+    expect(n == -1, "truncated index", n, -1);
+
+    /* garbled: a field past the last one, and fields out of order */
+    delta[0] = 6;
+    n = struct_delta_unpack(&r, FMT, delta, len);
+    expect(n == -1, "index past the end", n, -1);
+    delta[0] = 4;
+    delta[3] = 2;
+    n = struct_delta_unpack(&r, FMT, delta, len);
+    expect(n == -1, "indexes out of order", n, -1);
+
+    /* formats that are not fixed-size */
+    n = struct_delta_pack(delta, sizeof(delta), "!BV", &r0, &r1);
+    expect(n == -1, "varint format", n, -1);
+    n = struct_delta_patch(delta, "!B(H)#0", &r0, &r1);
+    expect(n == -1, "'#n' format", n, -1);
+
+    printf("%d failures\n", failures);
+    return failures != 0;
+}
@@ -0,0 +1,75 @@
+/*
+ * test_fields.c
+ *
+ * Pin the numbering of fields referenced by '#n' groups: every element of a
+ * numeric format character is one field, a 's' or 'p' string is one field,
+ * a bitfield is one field and 'x' pad bytes are not fields. struct_delta.c
+ * numbers fields the same way.
+ */
+#include "struct.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static int failures;
+
+/*
+ * the count of the group is 2 and every element is a 2 byte 'H', so the
+ * packed size tells which field the group read its count from.
+ */
+static void check(const char *fmt, const void *src, int size, int want)
+{
+    unsigned char buf[256];
+    unsigned char back[256];
+    int n;
+
+    n = struct_pack_into(buf, sizeof(buf), 0, fmt, (void *)src);
+    if (n != want) {
+        printf("struct_pack(\"%s\") = %d, want %d\n", fmt, n, want);
+        failures++;
+        return;
+    }
+    memset(back, 0, sizeof(back));
+    n = struct_unpack_from(buf, want, 0, fmt, back);
+    if (n != want || memcmp(back, src, size) != 0) {
+        printf("struct_unpack(\"%s\") = %d, want %d\n", fmt, n, want);
+        failures++;
+    }
+}
+
+#pragma pack(1)
+struct s_string { char s[3]; unsigned char n; unsigned short v[2]; };
+struct s_pascal { char p[4]; unsigned char n; unsigned short v[2]; };
+struct s_array { unsigned char a[3]; unsigned short v[2]; };
+struct s_pad { unsigned char n; unsigned short v[2]; };
+struct s_bits { unsigned char a; unsigned char b; unsigned char n;
+    unsigned short v[2]; };
+struct s_nested { unsigned char n; unsigned char m;
+    struct { unsigned char k; unsigned short v[2]; } g[2]; };
+#pragma pack()
+
+int main(void)
+{
+    struct s_string str = { "ab", 2, { 1, 2 } };
+    struct s_pascal pas = { "abc", 2, { 1, 2 } };
+    struct s_array arr = { { 9, 2, 9 }, { 1, 2 } };
+    struct s_pad pad = { 2, { 1, 2 } };
+    struct s_bits bits = { 5, 9, 2, { 1, 2 } };
+    struct s_nested nest = { 2, 9, { { 2, { 1, 2 } }, { 2, { 3, 4 } } } };
+
+    /* field 0 is the string, field 1 the count */
+    check("!3sB(H)#1", &str, sizeof(str), 3 + 1 + 4);
+    check("!4pB(H)#1", &pas, sizeof(pas), 4 + 1 + 4);
+    /* '3B' is fields 0, 1 and 2 */
+    check("!3B(H)#1", &arr, sizeof(arr), 3 + 4);
+    /* pad bytes are not fields */
+    check("!2xB(H)#0", &pad, sizeof(pad), 2 + 1 + 4);
+    /* a bitfield is one field */
+    check("!4t4tB(H)#2", &bits, sizeof(bits), 1 + 1 + 4);
+    /* fields inside groups keep counting in packing order, field 2 is the
+     * first 'B' of the first repetition */
+    check("!BB(B(H)#2)#0", &nest, sizeof(nest), 2 + 2 * (1 + 4));
+
+    printf("%d failures\n", failures);
+    return failures != 0;
+}
@@ -0,0 +1,198 @@
+/*
+ * test_frame.c
+ *
+ * Frames of struct_frame.h: the '!BBHI' header round-trips with records in
+ * either byte order, and a header counting more records than the buffer
+ * holds, a wrong byte order or version byte and a buffer shorter than the
+ * header are rejected with -1. Buffers are allocated to the exact size so the
+ * sanitizer build catches reads past them.
+ */
+#include "struct.h"
+#include "struct_frame.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define COUNT 5
+#define ID 0x1234
+
+static int failures;
+
+#pragma pack(1)
+struct sample {
+    uint16_t a;
+    uint16_t b;
+    uint32_t c;
+    uint64_t d;
+};
+#pragma pack()
+
+static void expect(int ok, const char *what, int got, int want)
+{
+    if (!ok) {
+        printf("%s: got %d, want %d\n", what, got, want);
+        failures++;
+    }
+}
+
+static struct sample samples[COUNT];
+
+/* a frame of COUNT samples in byte order order, copied to an exact-size
+ * buffer */
+static unsigned char *make_frame(char order, const char *fmt, int *len)
+{
+    unsigned char buf[256];
+    unsigned char *out;
+    struct_frame_t fr;
+    int i;
+
+    if (struct_frame_begin(&fr, buf, sizeof(buf), ID, order, fmt) < 0) {
+        return NULL;
+    }
+    for (i = 0; i < COUNT; i++) {
+        if (struct_frame_add(&fr, &samples[i]) < 0) {
+            return NULL;
+        }
+    }
+    *len = struct_frame_end(&fr);
+    out = malloc(*len);
+    if (out != NULL) {
+        memcpy(out, buf, *len);
+    }
+    return out;
+}
+
+static void test_round_trip(char order, const char *fmt)
+{
+    struct_frame_t fr;
+    struct sample s;
+    unsigned char *buf;
+    int len;
+    int n;
+    int i;
+
+    buf = make_frame(order, fmt, &len);
+    if (buf == NULL) {
+        expect(0, "make_frame", -1, 0);
+        return;
+    }
+    /* the header itself is packed as '!BBHI' */
+    expect(buf[0] == ((order == '!') ? '>' : order) || order == '=',
+            "order byte", buf[0], order);
+    expect(buf[1] == 1, "version byte", buf[1], 1);
+    expect(buf[2] == (ID >> 8) && buf[3] == (ID & 0xff), "id bytes",
+            buf[2] << 8 | buf[3], ID);
+    expect(buf[4] == 0 && buf[5] == 0 && buf[6] == 0 && buf[7] == COUNT,
+            "count bytes", buf[7], COUNT);
+    expect(struct_frame_id(buf, len) == ID, "struct_frame_id",
+            struct_frame_id(buf, len), ID);
+
+    n = struct_frame_open(&fr, buf, len, fmt);
+    expect(n == 0, "struct_frame_open", n, 0);
+    for (i = 0; n == 0 && i < COUNT; i++) {
+        memset(&s, 0, sizeof(s));
+        n = struct_frame_next(&fr, &s);
+        expect(n > 0 && memcmp(&s, &samples[i], sizeof(s)) == 0,
+                "struct_frame_next", n, 1);
+        n = (n > 0) ? 0 : -1;
+    }
+    n = struct_frame_next(&fr, &s);
+    expect(n == 0 && fr.offset == len, "end of frame", n, 0);
+    free(buf);
+}
+
+static void test_bad_headers(void)
+{
+    struct_frame_t fr;
+    unsigned char hdr[STRUCT_FRAME_HEADER_SIZE];
+    unsigned char *buf;
+    unsigned char *shorter;
+    unsigned char rec[sizeof(struct sample) + 8];
+    int len;
+    int n;
+    int i;
+
+    buf = make_frame('<', "HHIQ", &len);
+    if (buf == NULL) {
+        expect(0, "make_frame", -1, 0);
+        return;
+    }
+
+    /* more records than the buffer holds */
+    buf[7] = COUNT + 1;
+    n = struct_frame_open(&fr, buf, len, "HHIQ");
+    expect(n == -1, "count past the buffer", n, -1);
+    buf[4] = 0x80;
+    n = struct_frame_open(&fr, buf, len, "HHIQ");
+    expect(n == -1, "count past INT32_MAX", n, -1);
+    buf[4] = 0;
+    /* variable-size records run into the end of the buffer in next() */
+    n = struct_frame_open(&fr, buf, len, "HHIQV");
+    for (i = 0; n >= 0 && i <= COUNT + 1; i++) {
+        n = struct_frame_next(&fr, rec);
+    }
+    expect(n == -1, "variable records past the buffer", n, -1);
+    buf[7] = COUNT;
+
+    /* wrong byte order and version */
+    buf[0] = 'x';
+    expect(struct_frame_id(buf, len) == -1, "bad order byte",
+            struct_frame_id(buf, len), -1);
+    expect(struct_frame_open(&fr, buf, len, "HHIQ") == -1, "bad order open",
+            0, -1);
+    buf[0] = '<';
+    buf[1] = 2;
+    expect(struct_frame_id(buf, len) == -1, "bad version byte",
+            struct_frame_id(buf, len), -1);
+    expect(struct_frame_open(&fr, buf, len, "HHIQ") == -1,
+            "bad version open", 0, -1);
+    buf[1] = 1;
+
+    /* buffers shorter than the header */
+    for (i = 0; i < STRUCT_FRAME_HEADER_SIZE; i++) {
+        shorter = malloc(i + 1);
+        memcpy(shorter, buf, i);
+        n = struct_frame_id(shorter, i);
+        expect(n == -1, "short buffer id", n, -1);
+        n = struct_frame_open(&fr, shorter, i, "HHIQ");
+        expect(n == -1, "short buffer open", n, -1);
+        free(shorter);
+    }
+    n = struct_frame_begin(&fr, hdr, sizeof(hdr) - 1, ID, '<', "HHIQ");
+    expect(n == -1, "short buffer begin", n, -1);
+
+    /* a record that does not fit leaves the frame unchanged */
+    n = struct_frame_begin(&fr, hdr, sizeof(hdr), ID, '<', "HHIQ");
+    expect(n == 0 && struct_frame_add(&fr, &samples[0]) == -1
+            && struct_frame_end(&fr) == STRUCT_FRAME_HEADER_SIZE,
+            "record past the buffer", fr.count, 0);
+
+    /* bad ids and byte orders */
+    expect(struct_frame_begin(&fr, hdr, sizeof(hdr), 65536, '<', "H") == -1,
+            "id past 65535", 0, -1);
+    expect(struct_frame_begin(&fr, hdr, sizeof(hdr), ID, '@', "H") == -1,
+            "order '@'", 0, -1);
+    free(buf);
+}
+
+int main(void)
+{
+    int i;
+
+    for (i = 0; i < COUNT; i++) {
+        samples[i].a = (uint16_t)(i + 1);
+        samples[i].b = (uint16_t)(0x0102 * i);
+        samples[i].c = 0x01020304u * (uint32_t)i;
+        samples[i].d = 0x0102030405060708ULL * (uint64_t)i;
+    }
+    test_round_trip('<', "HHIQ");
+    test_round_trip('>', "HHIQ");
+    test_round_trip('!', "HHIQ");
+    test_round_trip('=', "!HHIQ");
+    test_bad_headers();
+
+    printf("%d failures\n", failures);
+    return failures != 0;
+}
@@ -0,0 +1,189 @@
+/*
+ * test_gen.c
+ *
+ * The code struct_gen writes for the formats of gen_formats.txt must pack and
+ * unpack the same bytes as the interpreter, both when called directly and
+ * when struct_pack(), struct_unpack(), struct_pack_into() and
+ * struct_unpack_from() dispatch to it, which is checked by counting the
+ * calls. The _into and _from dispatch must also reject short buffers and bad
+ * offsets like the interpreter.
+ *
+ * usage: test_gen [gen_formats.txt]
+ */
+#include "struct.h"
+#include "struct_compiled.h"
+#include "struct_internal.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_LINE 1024
+#define MAX_HOST 1024
+
+/* written by struct_gen -n register_gen_formats */
+extern void register_gen_formats(void);
+
+static int failures;
+
+/* the generated functions of the format under test, called through these */
+static struct_pack_fn gen_pack;
+static struct_unpack_fn gen_unpack;
+static int packs;
+static int unpacks;
+
+static int count_pack(void *buf, const void *src)
+{
+    packs++;
+    return gen_pack(buf, src);
+}
+
+static int count_unpack(const void *buf, void *dst)
+{
+    unpacks++;
+    return gen_unpack(buf, dst);
+}
+
+static void fail(const char *fmt, const char *what)
+{
+    printf("\"%s\": %s\n", fmt, what);
+    failures++;
+}
+
+static void check(const char *fmt)
+{
+    static unsigned char src[MAX_HOST];
+    static unsigned char want[MAX_HOST];
+    static unsigned char got[MAX_HOST + 1];
+    static unsigned char back1[MAX_HOST];
+    static unsigned char back2[MAX_HOST];
+    const struct struct_compiled *c;
+    struct_info_t info;
+    int size;
+    int i;
+
+    /* the interpreter first, nothing registered */
+    struct_unregister_all();
+    memset(&info, 0, sizeof(info));
+    if (struct_describe(fmt, &info) < 0 || !info.fixed
+            || info.host_size > MAX_HOST) {
+        fail(fmt, "bad test format");
+        return;
+    }
+    for (i = 0; i < MAX_HOST; i++) {
+        src[i] = (unsigned char)rand();
+    }
+    size = struct_pack(want, fmt, src);
+    memset(back1, 0x5a, sizeof(back1));
+    if (size != (int)info.size || struct_unpack(back1, fmt, want) != size) {
+        fail(fmt, "interpreter fails");
+        return;
+    }
+
+    register_gen_formats();
+    c = struct_compiled_find(fmt);
+    if (c == NULL) {
+        fail(fmt, "not registered by register_gen_formats()");
+        return;
+    }
+
+    /* the generated functions themselves */
+    memset(got, 0xa5, sizeof(got));
+    if (c->pack(got, src) != size || memcmp(got, want, size) != 0) {
+        fail(fmt, "generated pack differs from struct_pack()");
+    }
+    memset(back2, 0x5a, sizeof(back2));
+    if (c->unpack(want, back2) != size
+            || memcmp(back1, back2, info.host_size) != 0) {
+        fail(fmt, "generated unpack differs from struct_unpack()");
+    }
+
+    /* the public calls, which must go through the generated functions */
+    gen_pack = c->pack;
+    gen_unpack = c->unpack;
+    packs = 0;
+    unpacks = 0;
+    struct_register(fmt, count_pack, count_unpack);
+
+    memset(got, 0xa5, sizeof(got));
+    if (struct_pack(got, fmt, src) != size || memcmp(got, want, size) != 0) {
+        fail(fmt, "struct_pack() dispatch");
+    }
+    memset(got, 0xa5, sizeof(got));
+    if (struct_pack_into(got, size + 1, 1, fmt, src) != size
+            || got[0] != 0xa5 || memcmp(got + 1, want, size) != 0) {
+        fail(fmt, "struct_pack_into() dispatch");
+    }
+    memset(back2, 0x5a, sizeof(back2));
+    if (struct_unpack(back2, fmt, want) != size
+            || memcmp(back1, back2, info.host_size) != 0) {
+        fail(fmt, "struct_unpack() dispatch");
+    }
+    memset(back2, 0x5a, sizeof(back2));
+    if (struct_unpack_from(got, size + 1, 1, fmt, back2) != size
+            || memcmp(back1, back2, info.host_size) != 0) {
+        fail(fmt, "struct_unpack_from() dispatch");
+    }
+    if (packs != 2 || unpacks != 2) {
+        fail(fmt, "not dispatched to the generated code");
+    }
+
+    /* short buffers and bad offsets never reach the generated code */
+    if (struct_pack_into(got, size, 1, fmt, src) >= 0
+            || struct_pack_into(got, size + 1, -1, fmt, src) >= 0
+            || struct_pack_into(got, size, size + 1, fmt, src) >= 0) {
+        fail(fmt, "struct_pack_into() accepts a short buffer");
+    }
+    if (struct_unpack_from(got, size, 1, fmt, back2) >= 0
+            || struct_unpack_from(got, size + 1, -1, fmt, back2) >= 0
+            || struct_unpack_from(got, size, size + 1, fmt, back2) >= 0) {
+        fail(fmt, "struct_unpack_from() accepts a short buffer");
+    }
+    if (packs != 2 || unpacks != 2) {
+        fail(fmt, "generated code called on a short buffer");
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    const char *path = (argc > 1) ? argv[1] : "gen_formats.txt";
+    char line[MAX_LINE];
+    char *fmt;
+    char *end;
+    int tests = 0;
+    int i;
+    FILE *fp;
+
+    fp = fopen(path, "r");
+    if (fp == NULL) {
+        perror(path);
+        return 1;
+    }
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        for (fmt = line; isspace((unsigned char)*fmt); fmt++) {
+        }
+        end = fmt + strlen(fmt);
+        while (end > fmt && isspace((unsigned char)end[-1])) {
+            *--end = '\0';
+        }
+        if (*fmt == '\0' || *fmt == '#') {
+            continue;
+        }
+        /* fmt is kept by the registry, give it a copy that stays valid */
+        fmt = strdup(fmt);
+        for (i = 0; i < 16; i++) {
+            check(fmt);
+        }
+        struct_unregister_all();
+        free(fmt);
+        tests++;
+    }
+    fclose(fp);
+
+    if (tests == 0) {
+        fail(path, "no formats");
+    }
+    printf("%d failures\n", failures);
+    return failures != 0;
+}
@@ -0,0 +1,179 @@
+/*
+ * test_ids.c
+ *
+ * struct_pack_id() and struct_unpack_any() must write and read the same bytes
+ * as the interpreter, both for formats scanned into a plan when the id is
+ * registered (integers, strings and pad bytes) and for formats that are still
+ * interpreted (floats, half floats, bitfields, varints, '#n' groups and
+ * formats needing more steps than a plan holds). Also random formats of the
+ * planned characters, with every byte order, and id prefixes that are not the
+ * shortest encoding, which must be rejected.
+ */
+#include "struct.h"
+#include "struct_compiled.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_HOST 512
+
+static int failures;
+
+static void check(int id, const char *fmt)
+{
+    unsigned char src[MAX_HOST];
+    unsigned char want[MAX_HOST + 8];
+    unsigned char got[MAX_HOST + 8];
+    unsigned char back1[MAX_HOST];
+    unsigned char back2[MAX_HOST];
+    struct_info_t info;
+    int plen;
+    int wlen;
+    int glen;
+    int rid;
+    int i;
+
+    memset(&info, 0, sizeof(info));
+    if (struct_describe(fmt, &info) < 0 || info.host_size > MAX_HOST) {
+        printf("bad test format \"%s\"\n", fmt);
+        failures++;
+        return;
+    }
+    for (i = 0; i < MAX_HOST; i++) {
+        src[i] = (unsigned char)rand();
+    }
+    /* unpack the random bytes once so floats, varints and counts hold values
+     * the interpreter packs back unchanged */
+    plen = 0;
+    if (id >= 0x80) {
+        want[plen++] = (unsigned char)(id | 0x80);
+    }
+    want[plen++] = (unsigned char)(id >> ((id >= 0x80) ? 7 : 0));
+    wlen = struct_pack_into(want, sizeof(want), plen, fmt, src);
+    if (wlen < 0 || struct_unpack_from(want, wlen + plen, plen, fmt, src)
+            != wlen) {
+        printf("interpreter fails on \"%s\"\n", fmt);
+        failures++;
+        return;
+    }
+    wlen = struct_pack_into(want, sizeof(want), plen, fmt, src) + plen;
+
+    if (struct_register_id(id, fmt) < 0) {
+        printf("struct_register_id(\"%s\") failed\n", fmt);
+        failures++;
+        return;
+    }
+    memset(got, 0xa5, sizeof(got));
+    glen = struct_pack_id(got, sizeof(got), id, src);
+    if (glen != wlen || memcmp(got, want, wlen) != 0) {
+        printf("struct_pack_id(\"%s\") = %d, want %d\n", fmt, glen, wlen);
+        failures++;
+        return;
+    }
+    if (wlen > plen && struct_pack_id(got, wlen - 1, id, src) >= 0) {
+        printf("struct_pack_id(\"%s\") fits a short buffer\n", fmt);
+        failures++;
+    }
+
+    memset(back1, 0x5a, sizeof(back1));
+    memset(back2, 0x5a, sizeof(back2));
+    struct_unpack_from(want, wlen, plen, fmt, back1);
+    rid = -1;
+    glen = struct_unpack_any(want, wlen, &rid, back2);
+    if (glen != wlen || rid != id || memcmp(back1, back2, MAX_HOST) != 0) {
+        printf("struct_unpack_any(\"%s\") = %d, want %d\n", fmt, glen, wlen);
+        failures++;
+    }
+    if (wlen > plen && struct_unpack_any(want, wlen - 1, NULL, back2) >= 0) {
+        printf("struct_unpack_any(\"%s\") reads past the buffer\n", fmt);
+        failures++;
+    }
+}
+
+static void random_format(char *fmt)
+{
+    static const char orders[] = "=<>!";
+    static const char codes[] = "bBhHiIlLqQspx";
+    int n;
+    int k;
+
+    n = 0;
+    fmt[n++] = orders[rand() % 4];
+    for (k = rand() % 6 + 1; k > 0; k--) {
+        if (rand() % 8 == 0) {
+            n += sprintf(fmt + n, "%d(", rand() % 3 + 1);
+            n += sprintf(fmt + n, "%d%c", rand() % 3 + 1, codes[rand() % 13]);
+            fmt[n++] = ')';
+        } else {
+            if (rand() % 2) {
+                n += sprintf(fmt + n, "%d", rand() % 9 + 1);
+            }
+            fmt[n++] = codes[rand() % 13];
+        }
+    }
+    fmt[n] = '\0';
+}
+
+/* prefixes that are not the shortest encoding of an id select nothing */
+static void check_prefixes(void)
+{
+    static const struct {
+        unsigned char bytes[6];
+        int len;
+        int want;
+    } cases[] = {
+        { { 0x00, 0x00 }, 2, 2 },                       /* id 0, one byte */
+        { { 0xc8, 0x01, 0x00, 0x00, 0x00 }, 5, 5 },     /* id 200 */
+        { { 0x80, 0x00 }, 2, -1 },                      /* id 0, padded */
+        { { 0x81, 0x00 }, 2, -1 },                      /* id 1, padded */
+        { { 0xc8, 0x81, 0x00 }, 3, -1 },                /* id 200, padded */
+        { { 0x80, 0x80, 0x80, 0x80, 0x10 }, 5, -1 },    /* 1 << 32 */
+        { { 0x80, 0x80, 0x80, 0x80, 0x70 }, 5, -1 },    /* bits past 32 */
+        { { 0x80, 0x80, 0x80, 0x80, 0x80, 0x00 }, 6, -1 },
+        { { 0x80 }, 1, -1 },                            /* truncated */
+    };
+    unsigned char host[MAX_HOST];
+    int n;
+    int i;
+
+    struct_register_id(0, "!B");
+    struct_register_id(1, "!B");
+    struct_register_id(200, "!HB");
+    for (i = 0; i < (int)(sizeof(cases) / sizeof(cases[0])); i++) {
+        n = struct_unpack_any(cases[i].bytes, cases[i].len, NULL, host);
+        if (n != cases[i].want) {
+            printf("struct_unpack_any() of prefix case %d = %d, want %d\n",
+                    i, n, cases[i].want);
+            failures++;
+        }
+    }
+}
+
+int main(void)
+{
+    static const char *const fmts[] = {
+        /* planned */
+        "!HHIQ", "<HHIQ", "=HHIQ", "!16s16s6BBLLLL16BBBBB", "<b3xh2xiq",
+        "!2(HB)4xQ", "!4p", "<", "!B>H<I",
+        /* interpreted */
+        "!Hf", "<de", "!4t4tB", "<vV", "!B(H)#0", "<4z", "!BhBhBhBhBhBhBhBhBh",
+    };
+    char fmt[64];
+    int i;
+
+    srand(1);
+    for (i = 0; i < (int)(sizeof(fmts) / sizeof(fmts[0])); i++) {
+        check(i + 1, fmts[i]);
+    }
+    /* an id past 127 takes two varint bytes */
+    check(200, "!HHIQ");
+    check_prefixes();
+    for (i = 0; i < 2000; i++) {
+        random_format(fmt);
+        check(i % 100, fmt);
+    }
+
+    printf("%d failures\n", failures);
+    return failures != 0;
+}
@@ -0,0 +1,268 @@
+/*
+ * test_pipeline.c
+ *
+ * struct_pipeline_run() on a file, including a run stopped by the callback,
+ * which must leave the file offset right after the records handed out so a
+ * second run picks up where the first stopped, and a file ending inside a
+ * record, and on a socket written in odd-sized pieces so records straddle
+ * reads, and on a non-blocking pipe fed slowly, which must wait for data
+ * instead of spinning on EAGAIN.
+ *
+ * Built twice by the Makefile, with io_uring where available and with the
+ * I/O thread fallback (-DSTRUCT_PIPELINE_NO_URING).
+ */
+#include "struct.h"
+#include "struct_pipeline.h"
+
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define FMT "!HIQ"
+#define SIZE 14
+#define RECORDS 100003
+#define HEAD 2          /* bytes before the first record in the file */
+#define CHUNK 777       /* socket writes, not a multiple of SIZE */
+#define SLOW_CHUNKS 20  /* pieces of the slow writer, 10 ms apart */
+
+#pragma pack(1)
+struct rec {
+    uint16_t a;
+    uint32_t b;
+    uint64_t c;
+};
+#pragma pack()
+
+struct state {
+    long seen;
+    long stop_at;       /* stop once this many records are seen, or -1 */
+    int bad;
+};
+
+struct stream {
+    int fd;
+    const unsigned char *data;
+    int len;
+    int chunk;
+    int pause_ms;
+};
+
+static int failures;
+
+static void expect(int ok, const char *what, long got, long want)
+{
+    if (!ok) {
+        printf("%s: got %ld, want %ld\n", what, got, want);
+        failures++;
+    }
+}
+
+static int handle(void *arg, void *records, int n)
+{
+    struct state *st = arg;
+    struct rec *r = records;
+    int i;
+
+    for (i = 0; i < n; i++, st->seen++) {
+        if (r[i].a != (uint16_t)st->seen || r[i].b != (uint32_t)st->seen * 3
+                || r[i].c != (uint64_t)st->seen * 7) {
+            st->bad++;
+        }
+    }
+    return st->stop_at >= 0 && st->seen >= st->stop_at;
+}
+
+static void *writer(void *arg)
+{
+    struct stream *s = arg;
+    struct timespec ts;
+    int off = 0;
+    int k;
+
+    ts.tv_sec = 0;
+    ts.tv_nsec = s->pause_ms * 1000000L;
+    while (off < s->len) {
+        k = (s->len - off < s->chunk) ? s->len - off : s->chunk;
+        k = (int)write(s->fd, s->data + off, k);
+        if (k < 0) {
+            break;
+        }
+        off += k;
+        if (s->pause_ms > 0) {
+            nanosleep(&ts, NULL);
+        }
+    }
+    close(s->fd);
+    return NULL;
+}
+
+static void test_file(struct_pipeline_t *pl, const unsigned char *data,
+        int len)
+{
+    char path[] = "/tmp/test_pipelineXXXXXX";
+    struct state st = { 0, -1, 0 };
+    long n;
+    long first;
+    int fd;
+
+    fd = mkstemp(path);
+    if (fd < 0) {
+        perror("mkstemp");
+        failures++;
+        return;
+    }
+    unlink(path);
+    if (write(fd, "xx", HEAD) != HEAD || write(fd, data, len) != len) {
+        perror("write");
+        failures++;
+        close(fd);
+        return;
+    }
+
+    lseek(fd, HEAD, SEEK_SET);
+    n = struct_pipeline_run(pl, fd, handle, &st);
+    expect(n == RECORDS && st.seen == RECORDS && st.bad == 0, "file records",
+            n, RECORDS);
+    expect(lseek(fd, 0, SEEK_CUR) == HEAD + len, "file offset",
+            (long)lseek(fd, 0, SEEK_CUR), HEAD + len);
+
+    /* stop in the middle, the offset is after the records handed out */
+    st.seen = 0;
+    st.stop_at = 5000;
+    lseek(fd, HEAD, SEEK_SET);
+    first = struct_pipeline_run(pl, fd, handle, &st);
+    expect(first >= 5000 && first < RECORDS && first == st.seen,
+            "stopped run", first, 5000);
+    expect(lseek(fd, 0, SEEK_CUR) == HEAD + first * SIZE, "stopped offset",
+            (long)lseek(fd, 0, SEEK_CUR), HEAD + first * SIZE);
+
+    /* and the next run goes on from there */
+    st.stop_at = -1;
+    n = struct_pipeline_run(pl, fd, handle, &st);
+    expect(n == RECORDS - first && st.seen == RECORDS && st.bad == 0,
+            "resumed run", n, RECORDS - first);
+
+    /* a partial record at the end fails the run and is not consumed */
+    if (write(fd, "yyy", 3) != 3) {
+        failures++;
+    }
+    st.seen = 0;
+    lseek(fd, HEAD, SEEK_SET);
+    n = struct_pipeline_run(pl, fd, handle, &st);
+    expect(n == -1 && st.seen == RECORDS, "partial record", n, -1);
+    expect(lseek(fd, 0, SEEK_CUR) == HEAD + len, "partial record offset",
+            (long)lseek(fd, 0, SEEK_CUR), HEAD + len);
+    close(fd);
+}
+
+static void test_socket(struct_pipeline_t *pl, const unsigned char *data,
+        int len)
+{
+    struct state st = { 0, -1, 0 };
+    struct stream s;
+    pthread_t thread;
+    int sv[2];
+    long n;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+        perror("socketpair");
+        failures++;
+        return;
+    }
+    s.fd = sv[1];
+    s.data = data;
+    s.len = len;
+    s.chunk = CHUNK;
+    s.pause_ms = 0;
+    pthread_create(&thread, NULL, writer, &s);
+    n = struct_pipeline_run(pl, sv[0], handle, &st);
+    pthread_join(thread, NULL);
+    close(sv[0]);
+    expect(n == RECORDS && st.seen == RECORDS && st.bad == 0,
+            "socket records", n, RECORDS);
+}
+
+static double cpu_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void test_nonblocking(struct_pipeline_t *pl,
+        const unsigned char *data, int len)
+{
+    struct state st = { 0, -1, 0 };
+    struct stream s;
+    pthread_t thread;
+    double cpu;
+    int p[2];
+    long n;
+
+    if (pipe(p) < 0) {
+        perror("pipe");
+        failures++;
+        return;
+    }
+    fcntl(p[0], F_SETFL, fcntl(p[0], F_GETFL) | O_NONBLOCK);
+    s.fd = p[1];
+    s.data = data;
+    s.len = len;
+    s.chunk = (len + SLOW_CHUNKS - 1) / SLOW_CHUNKS;
+    s.pause_ms = 10;
+
+    cpu = cpu_ms();
+    pthread_create(&thread, NULL, writer, &s);
+    n = struct_pipeline_run(pl, p[0], handle, &st);
+    pthread_join(thread, NULL);
+    cpu = cpu_ms() - cpu;
+    close(p[0]);
+    expect(n == RECORDS && st.seen == RECORDS && st.bad == 0,
+            "non-blocking records", n, RECORDS);
+    /* the run takes about SLOW_CHUNKS * 10 ms, spinning would burn all of
+     * it, waiting for data only the time to copy and unpack */
+    expect(cpu < SLOW_CHUNKS * 10 / 2, "non-blocking cpu ms", (long)cpu,
+            SLOW_CHUNKS * 10 / 2);
+}
+
+int main(void)
+{
+    struct_pipeline_t *pl;
+    unsigned char *data;
+    struct rec r;
+    int len = RECORDS * SIZE;
+    int i;
+
+    data = malloc(len);
+    if (data == NULL) {
+        return 1;
+    }
+    for (i = 0; i < RECORDS; i++) {
+        r.a = (uint16_t)i;
+        r.b = (uint32_t)i * 3;
+        r.c = (uint64_t)i * 7;
+        struct_pack(data + (size_t)i * SIZE, FMT, &r);
+    }
+
+    expect(struct_pipeline_create("!V", 10, 4) == NULL,
+            "varint format accepted", 1, 0);
+    pl = struct_pipeline_create(FMT, 1000, 4);
+    if (pl == NULL) {
+        printf("struct_pipeline_create failed\n");
+        return 1;
+    }
+    test_file(pl, data, len);
+    test_socket(pl, data, len);
+    test_nonblocking(pl, data, len);
+    struct_pipeline_destroy(pl);
+    free(data);
+
+    printf("%d failures\n", failures);
+    return failures != 0;
+}
@@ -0,0 +1,121 @@
+/*
+ * test_swap.c
+ *
+ * struct_swap_inplace() and struct_swap_inplace_array(): a received record
+ * converted in place reads the same through a #pragma pack(1) struct as
+ * struct_unpack() gives, a second call restores the received bytes, all n
+ * records are converted, and formats whose fields are not as wide in the
+ * struct as packed are rejected with -1.
+ */
+#include "struct.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define NRECS 7
+
+static int failures;
+
+#pragma pack(1)
+struct rec {
+    uint8_t a;
+    uint16_t b;
+    uint32_t c;
+    uint64_t d;
+};
+#pragma pack()
+
+static void expect(int ok, const char *what, int got, int want)
+{
+    if (!ok) {
+        printf("%s: got %d, want %d\n", what, got, want);
+        failures++;
+    }
+}
+
+/* swap buf in place and compare with struct_unpack() of the same bytes */
+static void check(const char *fmt, int n, int host_size)
+{
+    unsigned char wire[1024];
+    unsigned char buf[1024];
+    unsigned char want[1024];
+    int size = struct_calcsize(fmt);
+    int ret;
+    int i;
+
+    for (i = 0; i < size * n; i++) {
+        wire[i] = (unsigned char)(i * 37 + 11);
+    }
+    memcpy(buf, wire, size * n);
+    for (i = 0; i < n; i++) {
+        struct_unpack(want + i * host_size, fmt, wire + i * size);
+    }
+
+    ret = (n == 1) ? struct_swap_inplace(buf, fmt)
+        : struct_swap_inplace_array(buf, fmt, n);
+    expect(ret == size * n, fmt, ret, size * n);
+    /* pad bytes are left alone, the rest must match */
+    if (host_size == size && memcmp(buf, want, size * n) != 0) {
+        printf("\"%s\" x %d does not match struct_unpack()\n", fmt, n);
+        failures++;
+    }
+    struct_swap_inplace_array(buf, fmt, n);
+    if (memcmp(buf, wire, size * n) != 0) {
+        printf("\"%s\" x %d is not restored by a second swap\n", fmt, n);
+        failures++;
+    }
+}
+
+int main(void)
+{
+    static const char *const rejected[] = {
+        "!He", "!HE", "!Hv", "!HV", "!H4z", "!H4r", "!B(H)#0", "!4t4t",
+    };
+    unsigned char buf[64];
+    unsigned char wire[15];
+    struct rec *r;
+    char many[256];
+    int n;
+    int i;
+
+    /* the example of the README: read the record through the struct */
+    for (i = 0; i < 15; i++) {
+        wire[i] = (unsigned char)(i + 1);
+    }
+    memcpy(buf, wire, sizeof(wire));
+    n = struct_swap_inplace(buf, "!BHIQ");
+    r = (struct rec *)buf;
+    expect(n == 15 && r->a == 0x01 && r->b == 0x0203 && r->c == 0x04050607
+            && r->d == 0x08090a0b0c0d0e0fULL, "!BHIQ fields", n, 15);
+
+    check("!BHIQ", 1, 15);
+    check("<BHIQ", 1, 15);
+    check("=BHIQ", 1, 15);
+    check("!BHIQ", NRECS, 15);
+    check("!4H", NRECS, 8);         /* one run over all records */
+    check("!2(HB)I", NRECS, 10);
+    check("!dfq", NRECS, 20);
+    check("!3sH2xI", 3, 9);         /* 's' and 'x' keep their bytes */
+
+    /* more runs than the plan holds, swapped by walking every record */
+    n = sprintf(many, "!");
+    for (i = 0; i < 40; i++) {
+        n += sprintf(many + n, "BH");
+    }
+    check(many, 3, 120);
+
+    for (i = 0; i < (int)(sizeof(rejected) / sizeof(rejected[0])); i++) {
+        memcpy(buf, wire, sizeof(wire));
+        n = struct_swap_inplace(buf, rejected[i]);
+        expect(n == -1 && memcmp(buf, wire, sizeof(wire)) == 0, rejected[i],
+                n, -1);
+    }
+    n = struct_swap_inplace_array(buf, "!H", -1);
+    expect(n == -1, "negative count", n, -1);
+    n = struct_swap_inplace_array(buf, "!H", 0);
+    expect(n == 0, "no records", n, 0);
+
+    printf("%d failures\n", failures);
+    return failures != 0;
+}
@@ -0,0 +1,127 @@
+/*
+ * test_vectors.c
+ *
+ * Replay vectors/cpython.txt, written by gen_vectors.py from CPython's struct
+ * module: every record must pack to the same bytes as CPython and unpack back
+ * to the same values, and struct_calcsize() must agree on sizes up to INT_MAX.
+ *
+ * usage: test_vectors [vectors/cpython.txt]
+ */
+#include "struct.h"
+#include "struct_endian.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_LINE 4096
+#define MAX_BYTES 1024
+
+static int hex_decode(const char *hex, unsigned char *out)
+{
+    unsigned int v;
+    int n = 0;
+
+    if (strcmp(hex, "-") == 0) {
+        return 0;
+    }
+    for (; hex[0] != '\0' && hex[1] != '\0' && n < MAX_BYTES; hex += 2) {
+        if (sscanf(hex, "%2x", &v) != 1) {
+            return -1;
+        }
+        out[n++] = (unsigned char)v;
+    }
+    return n;
+}
+
+static int check_pack(int lineno, const char *fmt,
+        const char *host_hex, const char *packed_hex)
+{
+    unsigned char host[MAX_BYTES];
+    unsigned char packed[MAX_BYTES];
+    unsigned char buf[MAX_BYTES];
+    int hlen;
+    int plen;
+    int n;
+
+    hlen = hex_decode(host_hex, host);
+    plen = hex_decode(packed_hex, packed);
+    if (hlen < 0 || plen < 0) {
+        printf("%d: bad vector\n", lineno);
+        return 1;
+    }
+
+    memset(buf, 0xa5, sizeof(buf));
+    n = struct_pack(buf, fmt, host);
+    if (n != plen || memcmp(buf, packed, plen) != 0) {
+        printf("%d: struct_pack(\"%s\") = %d, want %s\n",
+                lineno, fmt, n, packed_hex);
+        return 1;
+    }
+
+    memset(buf, 0xa5, sizeof(buf));
+    n = struct_unpack_from(packed, plen, 0, fmt, buf);
+    if (n != plen || memcmp(buf, host, hlen) != 0) {
+        printf("%d: struct_unpack_from(\"%s\") = %d, want %s\n",
+                lineno, fmt, n, host_hex);
+        return 1;
+    }
+    return 0;
+}
+
+static int check_calcsize(int lineno, const char *fmt, int size)
+{
+    int n;
+
+    n = struct_calcsize(fmt);
+    if (n != size) {
+        printf("%d: struct_calcsize(\"%s\") = %d, want %d\n",
+                lineno, fmt, n, size);
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *path = (argc > 1) ? argv[1] : "vectors/cpython.txt";
+    char line[MAX_LINE];
+    char fmt[MAX_LINE];
+    char a[MAX_LINE];
+    char b[MAX_LINE];
+    int lineno = 0;
+    int failures = 0;
+    int tests = 0;
+    int size;
+    FILE *fp;
+
+    if (struct_get_endian() != STRUCT_ENDIAN_LITTLE) {
+        printf("skipped, the vectors are for little-endian hosts\n");
+        return 0;
+    }
+
+    fp = fopen(path, "r");
+    if (fp == NULL) {
+        perror(path);
+        return 1;
+    }
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        lineno++;
+        if (line[0] == '#' || line[0] == '\n') {
+            continue;
+        }
+        if (sscanf(line, "P %s %s %s", fmt, a, b) == 3) {
+            failures += check_pack(lineno, fmt, a, b);
+        } else if (sscanf(line, "C %s %d", fmt, &size) == 2) {
+            failures += check_calcsize(lineno, fmt, size);
+        } else {
+            printf("%d: bad line\n", lineno);
+            failures++;
+        }
+        tests++;
+    }
+    fclose(fp);
+
+    printf("%d/%d vectors failed\n", failures, tests);
+    return failures != 0;
+}
@@ -0,0 +1,369 @@
+/*
+ * struct_gen.c
+ *
+ * Generate pack and unpack functions for fixed-size format strings, see
+ * struct_compiled.h.
+ *
+ * usage: struct_gen [-n name] [-o out.c] [formats.txt]
+ *
+ * formats are read one per line from the file or stdin, blank lines and
+ * lines starting with '#' are skipped. the generated C file defines
+ * pack_fmt_<hash>() and unpack_fmt_<hash>() for every format and
+ * void name(void), by default struct_register_generated(), which registers
+ * them with struct_register().
+ *
+ * build it from the library sources, it walks formats with the same parser:
+ *
+ * cc -Iinclude/struct -Isrc -o struct_gen tools/struct_gen.c src/struct.c \
+ *     src/struct_endian.c src/struct_crc32c.c src/struct_half.c \
+ *     src/struct_compiled.c -lm
+ */
+#include "struct.h"
+#include "struct_internal.h"
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_FORMATS 1024
+#define MAX_LINE 1024
+
+/* runs of this many elements or less are unrolled */
+#define UNROLL 8
+
+struct gen {
+    FILE *out;
+    int unpack;
+    /* pending plain copy, adjacent runs are merged into one memcpy() */
+    size_t copy_host;
+    size_t copy_wire;
+    size_t copy_len;
+};
+
+static const char *preamble =
+"#include \"struct_compiled.h\"\n"
+"\n"
+"#include <stdint.h>\n"
+"#include <string.h>\n"
+"\n"
+"/* native loads and stores, single moves on targets with unaligned access */\n"
+"static inline uint16_t ld16(const unsigned char *p)\n"
+"{ uint16_t v; memcpy(&v, p, 2); return v; }\n"
+"static inline uint32_t ld32(const unsigned char *p)\n"
+"{ uint32_t v; memcpy(&v, p, 4); return v; }\n"
+"static inline uint64_t ld64(const unsigned char *p)\n"
+"{ uint64_t v; memcpy(&v, p, 8); return v; }\n"
+"static inline void st16(unsigned char *p, uint16_t v) { memcpy(p, &v, 2); }\n"
+"static inline void st32(unsigned char *p, uint32_t v) { memcpy(p, &v, 4); }\n"
+"static inline void st64(unsigned char *p, uint64_t v) { memcpy(p, &v, 8); }\n"
+"\n"
+"/* fixed byte order, compilers turn these into a move plus bswap/movbe */\n"
+"static inline uint16_t ld16le(const unsigned char *p)\n"
+"{ return (uint16_t)(p[0] | p[1] << 8); }\n"
+"static inline uint16_t ld16be(const unsigned char *p)\n"
+"{ return (uint16_t)(p[0] << 8 | p[1]); }\n"
+"static inline uint32_t ld32le(const unsigned char *p)\n"
+"{ return (uint32_t)p[0] | (uint32_t)p[1] << 8\n"
+"    | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24; }\n"
+"static inline uint32_t ld32be(const unsigned char *p)\n"
+"{ return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16\n"
+"    | (uint32_t)p[2] << 8 | (uint32_t)p[3]; }\n"
+"static inline uint64_t ld64le(const unsigned char *p)\n"
+"{ return (uint64_t)ld32le(p + 4) << 32 | ld32le(p); }\n"
+"static inline uint64_t ld64be(const unsigned char *p)\n"
+"{ return (uint64_t)ld32be(p) << 32 | ld32be(p + 4); }\n"
+"static inline void st16le(unsigned char *p, uint16_t v)\n"
+"{ p[0] = (unsigned char)v; p[1] = (unsigned char)(v >> 8); }\n"
+"static inline void st16be(unsigned char *p, uint16_t v)\n"
+"{ p[0] = (unsigned char)(v >> 8); p[1] = (unsigned char)v; }\n"
+"static inline void st32le(unsigned char *p, uint32_t v)\n"
+"{ st16le(p, (uint16_t)v); st16le(p + 2, (uint16_t)(v >> 16)); }\n"
+"static inline void st32be(unsigned char *p, uint32_t v)\n"
+"{ st16be(p, (uint16_t)(v >> 16)); st16be(p + 2, (uint16_t)v); }\n"
+"static inline void st64le(unsigned char *p, uint64_t v)\n"
+"{ st32le(p, (uint32_t)v); st32le(p + 4, (uint32_t)(v >> 32)); }\n"
+"static inline void st64be(unsigned char *p, uint64_t v)\n"
+"{ st32be(p, (uint32_t)(v >> 32)); st32be(p + 4, (uint32_t)v); }\n"
+"\n"
+"/* NaNs are packed and unpacked as the quiet NaN, like struct_pack() */\n"
+"static inline uint32_t nan32(uint32_t v)\n"
+"{ return ((v & 0x7fffffffu) > 0x7f800000u) ? 0x7fc00000u : v; }\n"
+"static inline uint64_t nan64(uint64_t v)\n"
+"{ return ((v & 0x7fffffffffffffffull) > 0x7ff0000000000000ull)\n"
+"    ? 0x7ff8000000000000ull : v; }\n"
+"\n";
+
+/* FNV-1a, names the generated functions */
+static uint32_t hash_fmt(const char *fmt)
+{
+    uint32_t h = 2166136261u;
+
+    for (; *fmt != '\0'; fmt++) {
+        h = (h ^ (unsigned char)*fmt) * 16777619u;
+    }
+    return h;
+}
+
+static void flush_copy(struct gen *g)
+{
+    if (g->copy_len == 0) {
+        return;
+    }
+    if (g->unpack) {
+        fprintf(g->out, "    memcpy(s + %lu, b + %lu, %lu);\n",
+                (unsigned long)g->copy_host, (unsigned long)g->copy_wire,
+                (unsigned long)g->copy_len);
+    } else {
+        fprintf(g->out, "    memcpy(b + %lu, s + %lu, %lu);\n",
+                (unsigned long)g->copy_wire, (unsigned long)g->copy_host,
+                (unsigned long)g->copy_len);
+    }
+    g->copy_len = 0;
+}
+
+static void add_copy(struct gen *g, size_t host_offset, size_t wire_offset,
+        size_t len)
+{
+    if (g->copy_len > 0
+            && g->copy_host + g->copy_len == host_offset
+            && g->copy_wire + g->copy_len == wire_offset) {
+        g->copy_len += len;
+        return;
+    }
+    flush_copy(g);
+    g->copy_host = host_offset;
+    g->copy_wire = wire_offset;
+    g->copy_len = len;
+}
+
+/* one element: the conversion between b (packed) and s (struct) */
+static void emit_elem(struct gen *g, char endian, char c, int size,
+        const char *wire, const char *host)
+{
+    const char *order = "";
+    const char *nan = "";
+    int bits = size * 8;
+
+    if (endian == '<') {
+        order = "le";
+    } else if (endian == '>' || endian == '!') {
+        order = "be";
+    }
+    if (c == 'f' || c == 'd') {
+        nan = (c == 'f') ? "nan32" : "nan64";
+    }
+
+    if (g->unpack) {
+        fprintf(g->out, "st%d(s + %s, %s%sld%d%s(b + %s)%s);\n",
+                bits, host, nan, *nan ? "(" : "", bits, order, wire,
+                *nan ? ")" : "");
+    } else {
+        fprintf(g->out, "st%d%s(b + %s, %s%sld%d(s + %s)%s);\n",
+                bits, order, wire, nan, *nan ? "(" : "", bits, host,
+                *nan ? ")" : "");
+    }
+}
+
+static int emit_run(void *arg, char endian, char c, int count,
+        size_t host_offset, size_t wire_offset)
+{
+    struct gen *g = arg;
+    char wire[64];
+    char host[64];
+    int size = struct_wire_size(c);
+    int i;
+
+    if (c == 'x') {
+        if (!g->unpack) {
+            flush_copy(g);
+            fprintf(g->out, "    memset(b + %lu, 0, %d);\n",
+                    (unsigned long)wire_offset, count);
+        }
+        return 0;
+    }
+
+    /* generated code moves whole fields, the host field must be as wide */
+    if (struct_host_size(c) != size) {
+        fprintf(stderr, "struct_gen: '%c' is %d bytes in the struct and %d "
+                "packed, not supported\n", c, struct_host_size(c), size);
+        return -1;
+    }
+
+    /* bytes, strings and native integers are copied as they are */
+    if (size == 1 || (endian == '=' && c != 'f' && c != 'd')) {
+        add_copy(g, host_offset, wire_offset, (size_t)count * size);
+        return 0;
+    }
+    flush_copy(g);
+
+    if (count <= UNROLL) {
+        for (i = 0; i < count; i++) {
+            snprintf(wire, sizeof(wire), "%lu",
+                    (unsigned long)wire_offset + (unsigned long)i * size);
+            snprintf(host, sizeof(host), "%lu",
+                    (unsigned long)host_offset + (unsigned long)i * size);
+            fprintf(g->out, "    ");
+            emit_elem(g, endian, c, size, wire, host);
+        }
+        return 0;
+    }
+
+    fprintf(g->out, "    for (i = 0; i < %d; i++) {\n        ", count);
+    snprintf(wire, sizeof(wire), "%lu + %d * i",
+            (unsigned long)wire_offset, size);
+    snprintf(host, sizeof(host), "%lu + %d * i",
+            (unsigned long)host_offset, size);
+    emit_elem(g, endian, c, size, wire, host);
+    fprintf(g->out, "    }\n");
+    return 0;
+}
+
+static int emit_format(FILE *out, const char *fmt)
+{
+    struct gen g;
+    uint32_t h = hash_fmt(fmt);
+    int size;
+    int pass;
+
+    size = struct_walk_runs(fmt, NULL, NULL);
+    if (size < 0) {
+        fprintf(stderr, "struct_gen: %s: not a fixed-size format\n", fmt);
+        return -1;
+    }
+
+    g.out = out;
+    for (pass = 0; pass < 2; pass++) {
+        g.unpack = pass;
+        fprintf(out, "/* \"%s\" */\n", fmt);
+        if (g.unpack) {
+            fprintf(out, "static int unpack_fmt_%08x(const void *buf, "
+                    "void *dst)\n{\n", (unsigned int)h);
+            fprintf(out, "    const unsigned char *b = buf;\n");
+            fprintf(out, "    unsigned char *s = dst;\n");
+        } else {
+            fprintf(out, "static int pack_fmt_%08x(void *buf, "
+                    "const void *src)\n{\n", (unsigned int)h);
+            fprintf(out, "    unsigned char *b = buf;\n");
+            fprintf(out, "    const unsigned char *s = src;\n");
+        }
+        fprintf(out, "    int i;\n\n    (void)b;\n    (void)s;\n    (void)i;\n");
+        g.copy_len = 0;
+        if (struct_walk_runs(fmt, emit_run, &g) < 0) {
+            fprintf(stderr, "struct_gen: %s: cannot generate\n", fmt);
+            return -1;
+        }
+        flush_copy(&g);
+        fprintf(out, "    return %d;\n}\n\n", size);
+    }
+    return 0;
+}
+
+/* strip blanks around the format, NULL for blank and comment lines */
+static char *trim(char *line)
+{
+    char *end;
+
+    while (isspace((unsigned char)*line)) {
+        line++;
+    }
+    end = line + strlen(line);
+    while (end > line && isspace((unsigned char)end[-1])) {
+        *--end = '\0';
+    }
+    return (*line == '\0' || *line == '#') ? NULL : line;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *name = "struct_register_generated";
+    const char *outname = NULL;
+    const char *inname = NULL;
+    static char *fmts[MAX_FORMATS];
+    static uint32_t hashes[MAX_FORMATS];
+    char line[MAX_LINE];
+    FILE *in = stdin;
+    FILE *out = stdout;
+    char *fmt;
+    int nfmts = 0;
+    int i;
+    int j;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            name = argv[++i];
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            outname = argv[++i];
+        } else if (argv[i][0] == '-' || inname != NULL) {
+            fprintf(stderr, "usage: struct_gen [-n name] [-o out.c] "
+                    "[formats.txt]\n");
+            return 2;
+        } else {
+            inname = argv[i];
+        }
+    }
+
+    if (inname != NULL && (in = fopen(inname, "r")) == NULL) {
+        perror(inname);
+        return 1;
+    }
+    while (fgets(line, sizeof(line), in) != NULL) {
+        if ((fmt = trim(line)) == NULL) {
+            continue;
+        }
+        for (j = 0; j < nfmts && strcmp(fmts[j], fmt) != 0; j++) {
+        }
+        if (j < nfmts) {
+            continue; /* listed twice */
+        }
+        if (nfmts == MAX_FORMATS) {
+            fprintf(stderr, "struct_gen: more than %d formats\n",
+                    MAX_FORMATS);
+            return 1;
+        }
+        hashes[nfmts] = hash_fmt(fmt);
+        for (j = 0; j < nfmts; j++) {
+            if (hashes[j] == hashes[nfmts]) {
+                fprintf(stderr, "struct_gen: %s and %s have the same hash\n",
+                        fmts[j], fmt);
+                return 1;
+            }
+        }
+        fmts[nfmts++] = strdup(fmt);
+    }
+    if (in != stdin) {
+        fclose(in);
+    }
+
+    if (outname != NULL && (out = fopen(outname, "w")) == NULL) {
+        perror(outname);
+        return 1;
+    }
+    fprintf(out, "/* generated by struct_gen from %s, do not edit */\n",
+            (inname != NULL) ? inname : "stdin");
+    fputs(preamble, out);
+    for (i = 0; i < nfmts; i++) {
+        if (emit_format(out, fmts[i]) < 0) {
+            if (out != stdout) {
+                fclose(out);
+                remove(outname);
+            }
+            return 1;
+        }
+    }
+
+    fprintf(out, "void %s(void)\n{\n", name);
+    for (i = 0; i < nfmts; i++) {
+        fprintf(out, "    struct_register(\"%s\", pack_fmt_%08x, "
+                "unpack_fmt_%08x);\n", fmts[i],
+                (unsigned int)hashes[i], (unsigned int)hashes[i]);
+    }
+    fprintf(out, "}\n");
+
+    if (out != stdout && fclose(out) != 0) {
+        perror(outname);
+        return 1;
+    }
+    return 0;
+}